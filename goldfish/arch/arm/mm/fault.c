@@ -245,15 +245,18 @@ good_area:
 		fault = VM_FAULT_BADACCESS;
 
 		/* update wcounts if page write fault happens */
-		if(current->trace_flag){
-			current->wcounts++;
-			//printk("do_page_fault:: pid:%d, updated wcounts:%d\n",current->pid, current->wcounts);
-		}
+		ras_account_write(tsk, RAS_WRITE_PROT);
 
 		goto out;
 	}
 
-	return handle_mm_fault(mm, vma, addr & PAGE_MASK, flags);
+	fault = handle_mm_fault(mm, vma, addr & PAGE_MASK, flags);
+
+	/* count the COW, anonymous and shared page writes as well */
+	if (flags & FAULT_FLAG_WRITE)
+		ras_account_fault(tsk, vma, fault);
+
+	return fault;
 
 check_stack:
 	/* Don't allow expansion below FIRST_USER_ADDRESS */
@@ -150,8 +150,6 @@ extern struct task_group root_task_group;
  */
 #define INIT_TASK(tsk)	\
 {									\
-	.wcounts	= 0,						\
-	.trace_flag	=false,						\
 	.state		= 0,						\
 	.stack		= &init_thread_info,				\
 	.usage		= ATOMIC_INIT(2),				\
@@ -174,6 +172,8 @@ extern struct task_group root_task_group;
 	.ras	= {						\
 		.run_list	= LIST_HEAD_INIT(tsk.ras.run_list),	\
 		.time_slice	= RAS_TIMESLICE,				\
+		.nr_cpus_allowed = NR_CPUS,				\
+		.write_scale	= RAS_DEFAULT_WRITE_SCALE,		\
 	},								\
 	.tasks		= LIST_HEAD_INIT(tsk.tasks),			\
 	INIT_PUSHABLE_TASKS(tsk)					\
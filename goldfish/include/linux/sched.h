@@ -91,6 +91,7 @@ struct sched_param {
 #include <linux/latencytop.h>
 #include <linux/cred.h>
 #include <linux/llist.h>
+#include <linux/jump_label.h>
 
 #include <asm/processor.h>
 
@@ -151,6 +152,19 @@ extern unsigned long get_parent_ip(unsigned long addr);
 struct seq_file;
 struct cfs_rq;
 struct ras_rq;
+struct ras_notify;
+
+/*
+ * The kinds of page writes counted by the RAS write tracing.
+ */
+enum ras_write_type {
+	RAS_WRITE_PROT,		/* write to a vma that is not writable */
+	RAS_WRITE_COW,		/* copy-on-write break of a private page */
+	RAS_WRITE_ANON,		/* first write to an anonymous page */
+	RAS_WRITE_SHARED,	/* dirtying of a shared file page */
+	RAS_NR_WRITE_TYPES,
+};
+struct eventfd_ctx;
 struct task_group;
 #ifdef CONFIG_SCHED_DEBUG
 extern void proc_sched_show_task(struct task_struct *p, struct seq_file *m);
@@ -621,6 +635,10 @@ struct signal_struct {
 	unsigned long maxrss, cmaxrss;
 	struct task_io_accounting ioac;
 
+	/* Race-Averse Scheduler: page writes of the whole thread group */
+	atomic_t wcounts;
+	bool trace_group;	/* record whether every thread in the group is traced */
+
 	/*
 	 * Cumulative ns of schedule CPU time fo dead threads in the
 	 * group, not including a zombie group leader, (This only differs
@@ -1111,6 +1129,7 @@ struct sched_domain;
 #define WF_SYNC		0x01		/* waker goes to sleep after wakup */
 #define WF_FORK		0x02		/* child wakeup after fork */
 #define WF_MIGRATED	0x04		/* internal use, task got migrated */
+#define WF_FUTEX	0x08		/* futex handoff, see wake_up_futex() */
 
 #define ENQUEUE_WAKEUP		1
 #define ENQUEUE_HEAD		2
@@ -1250,16 +1269,63 @@ struct sched_rt_entity {
 #endif
 };
 
+/*
+ * A SCHED_RAS task that woke another one blocked on it by releasing a
+ * futex, counted on the woken task. Every task keeps its RAS_NR_CONTENDERS
+ * most frequent wakers, see ras_account_wakeup().
+ */
+#define RAS_NR_CONTENDERS	4
+
+struct ras_contender {
+	pid_t pid;		/* the waker, 0 for a free entry */
+	unsigned int count;	/* wakeups, halved every second */
+	u64 wait_ns;		/* time blocked before these wakeups */
+	int wcounts;		/* of the waker, -1 if it exited, see ras_get_contenders() */
+};
+
+/*
+ * Shared with a SCHED_RAS thread that registered it with ras_cs_register():
+ * the thread sets in_cs inside a critical section, and a slice that runs
+ * out meanwhile is extended once. The scheduler then sets yield_pending,
+ * and the thread calls sched_yield() when it leaves the section.
+ */
+struct ras_cs {
+	__u32 in_cs;
+	__u32 yield_pending;
+};
+
 struct sched_ras_entity {
+	/* read on every enqueue, pick and tick, keep them packed together */
 	struct list_head run_list;
+	unsigned int time_slice;
 	int weight;
 	int old_wcounts;
-	unsigned long timeout;
-	unsigned int time_slice;
-	int nr_cpus_allowed;
-
+	int nr_cpus_allowed;	/* maintained by do_set_cpus_allowed() */
+	int decay_base;		/* wcounts no longer counted for the weight */
+	unsigned long decay_stamp;	/* jiffies of the last decay */
+
+	/* per-task attributes, see sched_setattr_ras() */
+	int priority;		/* added to the weight */
+	int latency;		/* the time slice is shifted right by it */
+	int write_scale;	/* percent of wcounts counted for the weight */
+
+	/* write rate for the quarantine of write-heavy tasks */
+	bool racy;		/* runs on the racy cpus */
+	int rate_base;		/* wcounts at rate_stamp */
+	unsigned long rate_stamp;	/* jiffies of the last rate update */
+	bool background;	/* in the background group, see capacity_cpus_ras() */
+	bool slice_extended;	/* slice extended once, see task_tick_ras() */
+
+	/* critical section flag shared with userspace, see ras_cs_register() */
+	struct ras_cs __user *cs;
+
+	/* contention with other RAS tasks, under pi_lock */
+	bool contended;		/* last woken by a frequent contender */
+	int waker_cpu;		/* cpu of the last waker */
+	u64 sleep_stamp;	/* local_clock() when it blocked */
+	unsigned long contention_stamp;	/* jiffies of the last halving */
+	struct ras_contender contenders[RAS_NR_CONTENDERS];
 
-	struct sched_ras_entity *back;
 #ifdef CONFIG_RAS_GROUP_SCHED
 	struct sched_ras_entity	*parent;
 	/* rq on which this entity is (to be) queued: */
@@ -1277,6 +1343,24 @@ struct sched_ras_entity {
 #define RAS_TIMESLICE		(10 * HZ / 1000)
 #define RAS_BG_TIMESLICE	(5 * HZ / 1000)
 
+/*
+ * Per-task attributes of SCHED_RAS tasks: a static priority added to the
+ * weight, a latency sensitivity giving shorter slices that start sooner after
+ * a wakeup, and the percentage of the page writes counted for the weight
+ * (0 opts out of the write weighting).
+ */
+struct sched_ras_attr {
+	int priority;
+	int latency;
+	int write_scale;
+};
+
+#define RAS_MIN_PRIO		(-5)
+#define RAS_MAX_PRIO		5
+#define RAS_MAX_LATENCY		3
+#define RAS_MAX_WRITE_SCALE	1000
+#define RAS_DEFAULT_WRITE_SCALE	100
+
 struct rcu_node;
 
 enum perf_event_task_context {
@@ -1293,9 +1377,6 @@ struct task_struct {
 	unsigned int flags;	/* per process flags, defined below */
 	unsigned int ptrace;
 
-	int wcounts;	/* the page writes frequency */
-	bool trace_flag;	/* record whether the page writes is being traced */
-
 #ifdef CONFIG_SMP
 	struct llist_node wake_entry;
 	int on_cpu;
@@ -1307,7 +1388,8 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
-	struct sched_ras_entity ras;
+	/* starts a cache line, so its hot fields do not straddle two */
+	struct sched_ras_entity ras ____cacheline_aligned_in_smp;
 #ifdef CONFIG_CGROUP_SCHED
 	struct task_group *sched_task_group;
 #endif
@@ -1317,6 +1399,23 @@ struct task_struct {
 	struct hlist_head preempt_notifiers;
 #endif
 
+	/*
+	 * Page write tracing of the Race-Averse Scheduler. wcounts is dirtied
+	 * by every traced write fault, so it lives on a cache line of its own
+	 * instead of next to the fields read on every context switch.
+	 */
+	struct {
+		int wcounts;	/* the page writes frequency */
+		bool trace_flag;	/* record whether the page writes is being traced */
+		bool trace_inherit;	/* new task of a traced parent, see ras_trace_fork() */
+		bool trace_cgroup;	/* traced in a cpu.ras_enable group, which holds the reference */
+		struct ras_notify __rcu *ras_notify;	/* write pressure notification */
+		int wcounts_type[RAS_NR_WRITE_TYPES];	/* wcounts by enum ras_write_type */
+	} ____cacheline_aligned_in_smp;
+
+	/* ktime_get() in ns when the page writes counting started, see ras_trace_sample() */
+	u64 ras_trace_stamp;
+
 	/*
 	 * fpu_counter contains the number of consecutive context switches
 	 * that the FPU is used. If this is over a threshold, the lazy fpu
@@ -2063,7 +2162,11 @@ task_sched_runtime(struct task_struct *task);
 #ifdef CONFIG_SMP
 extern void sched_exec(void);
 #else
-#define sched_exec()   {}
+static inline void sched_exec(void)
+{
+	/* the critical section flag belongs to the old program image */
+	current->ras.cs = NULL;
+}
 #endif
 
 extern void sched_clock_idle_sleep_event(void);
@@ -2176,6 +2279,12 @@ extern int sched_setscheduler(struct task_struct *, int,
 			      const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
+extern int sched_setattr_ras(struct task_struct *, const struct sched_ras_attr *);
+extern void sched_getattr_ras(struct task_struct *, struct sched_ras_attr *);
+extern bool sched_may_change_ras(struct task_struct *p);
+extern int ras_check_rq(int cpu);
+extern void ras_account_wakeup(struct task_struct *p, int wake_flags);
+extern int ras_get_contenders(struct task_struct *p, struct ras_contender *c, int nr);
 extern struct task_struct *idle_task(int cpu);
 /**
  * is_idle_task - is the specified task an idle task?
@@ -2249,6 +2358,7 @@ extern void release_uids(struct user_namespace *ns);
 extern void xtime_update(unsigned long ticks);
 
 extern int wake_up_state(struct task_struct *tsk, unsigned int state);
+extern int wake_up_futex(struct task_struct *tsk);
 extern int wake_up_process(struct task_struct *tsk);
 extern void wake_up_new_task(struct task_struct *tsk);
 #ifdef CONFIG_SMP
@@ -2468,6 +2578,156 @@ static inline int thread_group_empty(struct task_struct *p)
 #define delay_group_leader(p) \
 		(thread_group_leader(p) && !thread_group_empty(p))
 
+/*
+ * Write pressure notification through an eventfd, see ras_notify_register().
+ */
+#define RAS_NOTIFY_WEIGHT	0x1	/* also notify when the RAS weight changes */
+
+extern int ras_notify_register(struct task_struct *p, struct eventfd_ctx *ctx,
+			       int wthreshold, int rate_threshold, int flags);
+extern void ras_notify_release(struct task_struct *p);
+extern int ras_notify_unregister(struct task_struct *p);
+extern void ras_notify_write(struct task_struct *tsk);
+
+extern int ras_cs_register(struct ras_cs __user *cs);
+
+/*
+ * Events recorded in the per-cpu RAS event buffers, see
+ * kernel/sched/ras_events.c. The layout is shared with userspace collectors.
+ */
+enum ras_event_type {
+	RAS_EVENT_ENQUEUE = 1,	/* arg: time_slice */
+	RAS_EVENT_DEQUEUE,	/* arg: 0 */
+	RAS_EVENT_PICK,		/* arg: time_slice left */
+	RAS_EVENT_PREEMPT,	/* switched out while runnable, arg: time_slice left */
+	RAS_EVENT_EXPIRE,	/* arg: new time_slice */
+	RAS_EVENT_MIGRATE,	/* arg: target cpu */
+	RAS_EVENT_WEIGHT,	/* arg: new weight */
+	RAS_EVENT_WRITE,	/* arg: writes since the last RAS_EVENT_WRITE */
+};
+
+#define RAS_EVENT_WRITE_BURST	16
+
+extern int ras_events_enabled;
+extern void __ras_event(int type, struct task_struct *p, int arg);
+
+static inline void ras_event(int type, struct task_struct *p, int arg)
+{
+	if (unlikely(ras_events_enabled))
+		__ras_event(type, p, arg);
+}
+
+/*
+ * Page write tracing is switched on and off per task with ras_trace_start()
+ * and ras_trace_stop(). ras_trace_key counts the traced tasks, so the write
+ * fault hook and the RAS write weighting cost nothing while none is traced.
+ */
+extern struct static_key ras_trace_key;
+
+extern bool ras_trace_start(struct task_struct *p);
+extern bool ras_trace_stop(struct task_struct *p);
+extern bool ras_trace_set(struct task_struct *p, bool on);
+extern void ras_trace_get(void);
+extern void ras_trace_put(void);
+extern void ras_trace_fork(struct task_struct *p);
+extern void ras_trace_exit(struct task_struct *p);
+extern void ras_trace_put_deferred(void);
+
+static inline bool ras_tracing(void)
+{
+	return static_key_false(&ras_trace_key);
+}
+
+/*
+ * Whether the page writes of @tsk are traced, on its own or as a task of a
+ * cpu.ras_enable group.
+ */
+static inline bool ras_traced(struct task_struct *tsk)
+{
+	return tsk->trace_flag || tsk->trace_cgroup;
+}
+
+/*
+ * Count one page write of @tsk, of enum ras_write_type @type, if its page
+ * writes are being traced.
+ */
+static inline void ras_account_write(struct task_struct *tsk, int type)
+{
+	if (!ras_tracing() || !ras_traced(tsk))
+		return;
+
+	tsk->wcounts++;
+	tsk->wcounts_type[type]++;
+	if (tsk->signal->trace_group)
+		atomic_inc(&tsk->signal->wcounts);
+
+	if (unlikely(rcu_access_pointer(tsk->ras_notify)))
+		ras_notify_write(tsk);
+
+	if (unlikely(ras_events_enabled) && !(tsk->wcounts % RAS_EVENT_WRITE_BURST))
+		__ras_event(RAS_EVENT_WRITE, tsk, RAS_EVENT_WRITE_BURST);
+}
+
+extern void __ras_account_fault(struct task_struct *tsk,
+				struct vm_area_struct *vma, unsigned int fault);
+
+/*
+ * Count the write fault of @tsk on @vma that handle_mm_fault() resolved
+ * with result @fault.
+ *
+ * The write fault hooks are the same on every architecture: its page fault
+ * handler calls ras_account_write(tsk, RAS_WRITE_PROT) when it refuses a
+ * write to a vma without VM_WRITE, and ras_account_fault() after
+ * handle_mm_fault() of a write (FAULT_FLAG_WRITE). arch/arm/mm/fault.c and
+ * arch/x86/mm/fault.c make them. Nothing else of the tracing depends on the
+ * architecture.
+ */
+static inline void ras_account_fault(struct task_struct *tsk,
+				     struct vm_area_struct *vma, unsigned int fault)
+{
+	if (ras_tracing() && ras_traced(tsk))
+		__ras_account_fault(tsk, vma, fault);
+}
+
+/*
+ * Restart the page writes counting of @p.
+ */
+static inline void ras_reset_wcounts(struct task_struct *p)
+{
+	p->wcounts = 0;
+	memset(p->wcounts_type, 0, sizeof(p->wcounts_type));
+	p->ras_trace_stamp = ktime_to_ns(ktime_get());
+}
+
+/*
+ * The page writes of a task since its counting started, from
+ * ras_trace_sample(). The writes of an interval are the difference of two
+ * samples with the same start_ns. The layout is shared with userspace.
+ */
+struct ras_trace_sample {
+	pid_t pid;
+	int traced;		/* 1 traced, 0 not traced, -ESRCH no such task, -EPERM no access */
+	int wcounts;
+	int wcounts_type[RAS_NR_WRITE_TYPES];
+	u64 start_ns;		/* start_trace, ktime_get() */
+	u64 now_ns;		/* this sample */
+};
+
+extern int ras_trace_sample(struct task_struct *p, struct ras_trace_sample *s);
+extern bool ras_may_read(struct task_struct *p);
+
+/*
+ * The page writes frequency the RAS weight of @p is computed from: the total
+ * of its thread group while the whole group is traced, its own otherwise.
+ */
+static inline int ras_wcounts(struct task_struct *p)
+{
+	if (p->signal->trace_group)
+		return atomic_read(&p->signal->wcounts);
+
+	return p->wcounts;
+}
+
 /*
  * Protects ->fs, ->files, ->mm, ->group_info, ->comm, keyring
  * subscriptions and synchronises with wait4().  Also used in procfs.  Also
@@ -1594,6 +1594,10 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	if (p->on_rq && ttwu_remote(p, wake_flags))
 		goto stat;
 
+	/* count the RAS task handing a futex to p before it is placed */
+	if (p->policy == SCHED_RAS)
+		ras_account_wakeup(p, wake_flags);
+
 #ifdef CONFIG_SMP
 	/*
 	 * If the owning (remote) cpu is still in the middle of schedule() with
@@ -1700,6 +1704,18 @@ int wake_up_state(struct task_struct *p, unsigned int state)
 	return try_to_wake_up(p, state, 0);
 }
 
+/**
+ * wake_up_futex - wake up a task blocked on a futex the current task released
+ * @p: The process to be woken up.
+ *
+ * Like wake_up_state(p, TASK_NORMAL), but the wakeup is a lock handoff:
+ * only these count as contention between RAS tasks.
+ */
+int wake_up_futex(struct task_struct *p)
+{
+	return try_to_wake_up(p, TASK_NORMAL, WF_FUTEX);
+}
+
 /*
  * Perform scheduler related setup for a newly forked process p.
  * p is forked by current.
@@ -1725,6 +1741,29 @@ static void __sched_fork(struct task_struct *p)
 	INIT_LIST_HEAD(&p->rt.run_list);
 
 	INIT_LIST_HEAD(&p->ras.run_list);
+	p->ras.decay_base = 0;
+	p->ras.decay_stamp = jiffies;
+	p->ras.racy = false;
+	p->ras.rate_base = 0;
+	p->ras.rate_stamp = jiffies;
+	p->ras.background = false;
+	p->ras.slice_extended = false;
+	p->ras.cs = NULL;
+	p->ras.contended = false;
+	p->ras.sleep_stamp = 0;
+	p->ras.contention_stamp = jiffies;
+	memset(p->ras.contenders, 0, sizeof(p->ras.contenders));
+
+	/*
+	 * trace_flag is inherited so that new threads of a traced group are
+	 * traced as well, but every task counts its own page writes. The
+	 * child is only traced once wake_up_new_task() took its reference.
+	 */
+	p->trace_inherit = p->trace_flag;
+	p->trace_flag = false;
+	p->trace_cgroup = false;
+	ras_reset_wcounts(p);
+	RCU_INIT_POINTER(p->ras_notify, NULL);
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
@@ -1766,6 +1805,10 @@ void sched_fork(struct task_struct *p)
 		p->prio = p->normal_prio = __normal_prio(p);
 		set_load_weight(p);
 
+		p->ras.priority = 0;
+		p->ras.latency = 0;
+		p->ras.write_scale = RAS_DEFAULT_WRITE_SCALE;
+
 		/*
 		 * We don't need the reset flag anymore after the fork. It has
 		 * fulfilled its duty:
@@ -1773,8 +1816,17 @@ void sched_fork(struct task_struct *p)
 		p->sched_reset_on_fork = 0;
 	}
 
+#ifdef CONFIG_CGROUP_SCHED
+	/* a group with cpu.ras_enable runs its new tasks traced as SCHED_RAS */
+	if (unlikely(p->sched_task_group->ras_enable) && !task_has_rt_policy(p)) {
+		p->policy = SCHED_RAS;
+		p->trace_cgroup = true;
+	}
+#endif
+
 	if (!rt_prio(p->prio))
-		p->sched_class = &fair_sched_class;
+		p->sched_class = p->policy == SCHED_RAS ?
+			&ras_sched_class : &fair_sched_class;
 
 	if (p->sched_class->task_fork)
 		p->sched_class->task_fork(p);
@@ -1815,11 +1867,28 @@ void sched_fork(struct task_struct *p)
  * that must be done for every newly created context, then puts the task
  * on the runqueue and wakes it.
  */
+#ifdef CONFIG_CGROUP_SCHED
+static void cpu_cgroup_set_ras(struct task_struct *p, bool enable);
+#endif
+
 void wake_up_new_task(struct task_struct *p)
 {
 	unsigned long flags;
 	struct rq *rq;
 
+	if (unlikely(p->trace_inherit))
+		ras_trace_fork(p);
+
+#ifdef CONFIG_CGROUP_SCHED
+	/*
+	 * cpu.ras_enable may have been written after sched_fork() read it and
+	 * before cgroup_post_fork() put p on the task list of its group, where
+	 * the cgroup_scan_tasks() of the writer would have found it.
+	 */
+	if (unlikely(p->trace_cgroup != !!p->sched_task_group->ras_enable))
+		cpu_cgroup_set_ras(p, p->sched_task_group->ras_enable);
+#endif
+
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 #ifdef CONFIG_SMP
 	/*
@@ -1980,6 +2049,8 @@ static void finish_task_switch(struct rq *rq, struct task_struct *prev)
 		 * task and put them back on the free list.
 		 */
 		kprobe_flush_task(prev);
+		ras_notify_release(prev);
+		ras_trace_exit(prev);
 		put_task_struct(prev);
 	}
 }
@@ -2690,6 +2761,9 @@ void sched_exec(void)
 	unsigned long flags;
 	int dest_cpu;
 
+	/* the critical section flag belongs to the old program image */
+	p->ras.cs = NULL;
+
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 	dest_cpu = p->sched_class->select_task_rq(p, SD_BALANCE_EXEC, 0);
 	if (dest_cpu == smp_processor_id())
@@ -3383,6 +3457,8 @@ need_resched:
 		rq->curr = next;
 		++*switch_count;
 
+		update_ras_cpu(rq, prev, next);
+
 		context_switch(rq, prev, next); /* unlocks the rq */
 		/*
 		 * The context switch have flipped the stack from under us
@@ -3983,10 +4059,11 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 		dequeue_task(rq, p, 0);
 	if (running)
 		p->sched_class->put_prev_task(rq, p);
-	if (p->policy == SCHED_RAS)
-		p->sched_class = &ras_sched_class;
-	else if (rt_prio(prio))
+	/* a boosted SCHED_RAS task runs as RT until it is deboosted */
+	if (rt_prio(prio))
 		p->sched_class = &rt_sched_class;
+	else if (p->policy == SCHED_RAS)
+		p->sched_class = &ras_sched_class;
 	else
 		p->sched_class = &fair_sched_class;
 
@@ -4177,11 +4254,11 @@ __setscheduler(struct rq *rq, struct task_struct *p, int policy, int prio)
 	p->normal_prio = normal_prio(p);
 	/* we are holding p->pi_lock already */
 	p->prio = rt_mutex_getprio(p);
-	/* check if the policy is SCHED_RAS */
-	if (policy == SCHED_RAS)
-		p->sched_class = &ras_sched_class;
-	else if (rt_prio(p->prio))
+	/* check if the policy is SCHED_RAS, unless the task is PI boosted */
+	if (rt_prio(p->prio))
 		p->sched_class = &rt_sched_class;
+	else if (policy == SCHED_RAS)
+		p->sched_class = &ras_sched_class;
 	else
 		p->sched_class = &fair_sched_class;
 	set_load_weight(p);
@@ -4505,6 +4582,74 @@ out_unlock:
 	return retval;
 }
 
+/**
+ * sched_setattr_ras - set the SCHED_RAS attributes of a task.
+ * @p: the task in question.
+ * @attr: the new attributes.
+ *
+ * Like raising an RT priority, raising the priority or the latency
+ * sensitivity, or lowering the write scale, needs CAP_SYS_NICE. The new
+ * attributes are used from the next time slice of the task on.
+ */
+int sched_setattr_ras(struct task_struct *p, const struct sched_ras_attr *attr)
+{
+	unsigned long flags;
+	struct rq *rq;
+	int retval;
+
+	if (attr->priority < RAS_MIN_PRIO || attr->priority > RAS_MAX_PRIO ||
+	    attr->latency < 0 || attr->latency > RAS_MAX_LATENCY ||
+	    attr->write_scale < 0 || attr->write_scale > RAS_MAX_WRITE_SCALE)
+		return -EINVAL;
+
+	if (!capable(CAP_SYS_NICE)) {
+		if (!check_same_owner(p))
+			return -EPERM;
+		if (attr->priority > p->ras.priority ||
+		    attr->latency > p->ras.latency ||
+		    attr->write_scale < p->ras.write_scale)
+			return -EPERM;
+	}
+
+	retval = security_task_setscheduler(p);
+	if (retval)
+		return retval;
+
+	rq = task_rq_lock(p, &flags);
+	p->ras.priority = attr->priority;
+	p->ras.latency = attr->latency;
+	p->ras.write_scale = attr->write_scale;
+	task_rq_unlock(rq, p, &flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_setattr_ras);
+
+/**
+ * sched_getattr_ras - get the SCHED_RAS attributes of a task.
+ * @p: the task in question.
+ * @attr: structure to store the attributes in.
+ */
+void sched_getattr_ras(struct task_struct *p, struct sched_ras_attr *attr)
+{
+	attr->priority = p->ras.priority;
+	attr->latency = p->ras.latency;
+	attr->write_scale = p->ras.write_scale;
+}
+EXPORT_SYMBOL_GPL(sched_getattr_ras);
+
+/**
+ * sched_may_change_ras - may the current task change the RAS scheduling of p?
+ * @p: the task in question.
+ *
+ * The check of sched_setaffinity(): the same owner as @p, or CAP_SYS_NICE.
+ */
+bool sched_may_change_ras(struct task_struct *p)
+{
+	return check_same_owner(p) || ns_capable(task_user_ns(p), CAP_SYS_NICE);
+}
+EXPORT_SYMBOL_GPL(sched_may_change_ras);
+
 long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 {
 	cpumask_var_t cpus_allowed, new_mask;
@@ -5320,6 +5465,9 @@ static void migrate_tasks(unsigned int dead_cpu)
 	/* Ensure any throttled groups are reachable by pick_next_task */
 	unthrottle_offline_cfs_rqs(rq);
 
+	/* Spread the RAS tasks over the active cpus first */
+	drain_offline_ras_rq(rq);
+
 	for ( ; ; ) {
 		/*
 		 * There's this thread running, bail when that's the only
@@ -5829,6 +5977,8 @@ static void free_rootdomain(struct rcu_head *rcu)
 	struct root_domain *rd = container_of(rcu, struct root_domain, rcu);
 
 	cpupri_cleanup(&rd->cpupri);
+	raspri_cleanup(&rd->raspri);
+	free_cpumask_var(rd->ras_idle);
 	free_cpumask_var(rd->rto_mask);
 	free_cpumask_var(rd->online);
 	free_cpumask_var(rd->span);
@@ -5882,11 +6032,19 @@ static int init_rootdomain(struct root_domain *rd)
 		goto free_span;
 	if (!alloc_cpumask_var(&rd->rto_mask, GFP_KERNEL))
 		goto free_online;
+	if (!zalloc_cpumask_var(&rd->ras_idle, GFP_KERNEL))
+		goto free_rto_mask;
 
 	if (cpupri_init(&rd->cpupri) != 0)
-		goto free_rto_mask;
+		goto free_ras_idle;
+	if (raspri_init(&rd->raspri) != 0)
+		goto free_cpupri;
 	return 0;
 
+free_cpupri:
+	cpupri_cleanup(&rd->cpupri);
+free_ras_idle:
+	free_cpumask_var(rd->ras_idle);
 free_rto_mask:
 	free_cpumask_var(rd->rto_mask);
 free_online:
@@ -7049,6 +7207,7 @@ void __init sched_init_smp(void)
 	free_cpumask_var(non_isolated_cpus);
 
 	init_sched_rt_class();
+	init_sched_ras_class();
 }
 #else
 void __init sched_init_smp(void)
@@ -7836,6 +7995,10 @@ static void cpu_cgroup_destroy(struct cgroup *cgrp)
 {
 	struct task_group *tg = cgroup_tg(cgrp);
 
+	/* under cgroup_mutex, which must not nest around the jump label locks */
+	if (xchg(&tg->ras_enable, 0))
+		ras_trace_put_deferred();
+
 	sched_destroy_group(tg);
 }
 
@@ -7867,20 +8030,52 @@ static int cpu_cgroup_can_attach(struct cgroup *cgrp,
 			return -EINVAL;
 #else
 		/* We don't support RT-tasks being in separate groups */
-		if (task->sched_class != &fair_sched_class)
+		if (task->sched_class != &fair_sched_class &&
+		    task->sched_class != &ras_sched_class)
 			return -EINVAL;
 #endif
 	}
 	return 0;
 }
 
+/*
+ * Switch p to traced SCHED_RAS for cpu.ras_enable, or back to SCHED_NORMAL
+ * untraced. RT tasks keep their policy. The tracing of p is covered by the
+ * reference the group holds on ras_trace_key, so nothing here touches the
+ * key: this runs under cgroup_mutex from cpu_cgroup_attach().
+ */
+static void cpu_cgroup_set_ras(struct task_struct *p, bool enable)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	if (task_has_rt_policy(p) || (p->flags & PF_EXITING))
+		return;
+
+	if (enable) {
+		p->trace_cgroup = true;
+		if (p->policy != SCHED_RAS)
+			sched_setscheduler_nocheck(p, SCHED_RAS, &param);
+	} else {
+		if (p->policy == SCHED_RAS)
+			sched_setscheduler_nocheck(p, SCHED_NORMAL, &param);
+		p->trace_cgroup = false;
+	}
+}
+
 static void cpu_cgroup_attach(struct cgroup *cgrp,
 			      struct cgroup_taskset *tset)
 {
+	struct task_group *tg = cgroup_tg(cgrp), *old_tg;
 	struct task_struct *task;
 
-	cgroup_taskset_for_each(task, cgrp, tset)
+	cgroup_taskset_for_each(task, cgrp, tset) {
+		old_tg = cgroup_tg(cgroup_taskset_cur_cgroup(tset));
 		sched_move_task(task);
+		if (tg->ras_enable)
+			cpu_cgroup_set_ras(task, true);
+		else if (old_tg->ras_enable || task->trace_cgroup)
+			cpu_cgroup_set_ras(task, false);
+	}
 }
 
 static void
@@ -8144,6 +8339,62 @@ static int cpu_stats_show(struct cgroup *cgrp, struct cftype *cft,
 #endif /* CONFIG_CFS_BANDWIDTH */
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
+static void cpu_ras_enable_task(struct task_struct *p,
+				struct cgroup_scanner *scan)
+{
+	cpu_cgroup_set_ras(p, cgroup_tg(scan->cg)->ras_enable);
+}
+
+/*
+ * Writing 1 switches every task of the group to traced SCHED_RAS, and the
+ * tasks forked in or moved to the group later. Writing 0 switches the
+ * SCHED_RAS tasks of the group back to SCHED_NORMAL and stops tracing them.
+ * The tasks are switched in one cgroup_scan_tasks() pass, in batches taken
+ * under css_set_lock. A task forked too late to be found by the pass checks
+ * ras_enable again in wake_up_new_task().
+ *
+ * While ras_enable is set the group holds one reference on ras_trace_key
+ * for all its tasks. It is taken and dropped here, outside cgroup_mutex and
+ * ras_enable_mutex, and ras_enable is switched with xchg() so that exactly
+ * one of the writers and cpu_cgroup_destroy() drops it.
+ */
+static int cpu_ras_enable_write_u64(struct cgroup *cgrp, struct cftype *cft,
+				    u64 enable)
+{
+	static DEFINE_MUTEX(ras_enable_mutex);
+	struct task_group *tg = cgroup_tg(cgrp);
+	struct cgroup_scanner scan = {
+		.cg = cgrp,
+		.process_task = cpu_ras_enable_task,
+	};
+	int ret, was;
+
+	/* not every task of the system */
+	if (!cgrp->parent)
+		return -EINVAL;
+	if (enable > 1)
+		return -EINVAL;
+
+	if (enable)
+		ras_trace_get();
+
+	mutex_lock(&ras_enable_mutex);
+	was = xchg(&tg->ras_enable, (int)enable);
+	ret = cgroup_scan_tasks(&scan);
+	mutex_unlock(&ras_enable_mutex);
+
+	/* the reference of the group was already there, or is no longer needed */
+	if (was)
+		ras_trace_put();
+
+	return ret;
+}
+
+static u64 cpu_ras_enable_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->ras_enable;
+}
+
 #ifdef CONFIG_RT_GROUP_SCHED
 static int cpu_rt_runtime_write(struct cgroup *cgrp, struct cftype *cft,
 				s64 val)
@@ -8204,6 +8455,11 @@ static struct cftype cpu_files[] = {
 		.write_u64 = cpu_rt_period_write_uint,
 	},
 #endif
+	{
+		.name = "ras_enable",
+		.read_u64 = cpu_ras_enable_read_u64,
+		.write_u64 = cpu_ras_enable_write_u64,
+	},
 };
 
 static int cpu_cgroup_populate(struct cgroup_subsys *ss, struct cgroup *cont)
@@ -5,15 +5,83 @@
 #include "sched.h"
 
 #include <linux/slab.h>
+#include <linux/eventfd.h>
+#include <linux/irq_work.h>
+#include <linux/module.h>
+#include <linux/sysctl.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/ptrace.h>
+#include <linux/cpu.h>
+
+#ifdef CONFIG_RT_MUTEXES
+#include "../rtmutex_common.h"
+#endif
 
 /*
- * Print some information to debug and show result.
+ * Tunables of the RAS scheduler, in /proc/sys/kernel/sched_ras_*.
+ * Times are set in ms and converted to jiffies once for the hot paths.
  */
-static void debug(char *name, struct rq *rq, struct task_struct *p)
-{
-    printk("%s:: pid: %d,wcounts: %d,total_wcounts: %d,time_slice: %u,nr: %lu\n", name,
-           p->pid, p->wcounts, rq->ras.total_wcounts, p->ras.time_slice, rq->ras.ras_nr_running);
-}
+unsigned int sysctl_sched_ras_latency __read_mostly = 100;      /* ms, 0: fixed slices */
+unsigned int sysctl_sched_ras_min_granularity __read_mostly = 2; /* ms */
+unsigned int sysctl_sched_ras_timeslice __read_mostly = 10;     /* ms, per weight unit */
+unsigned int sysctl_sched_ras_bg_timeslice __read_mostly = 5;   /* ms */
+unsigned int sysctl_sched_ras_min_weight __read_mostly = 1;
+unsigned int sysctl_sched_ras_max_weight __read_mostly = 10;
+unsigned int sysctl_sched_ras_decay_period __read_mostly;       /* ms, 0: never decay */
+unsigned int sysctl_sched_ras_migration_cost __read_mostly;     /* wcounts */
+
+/*
+ * Quarantine of write-heavy tasks: while sched_ras_quarantine is set, tasks
+ * writing more than sched_ras_racy_enter pages per second run on the cpus
+ * of sched_ras_racy_cpus and the others off them. A task only leaves the
+ * racy cpus when its rate falls below sched_ras_racy_exit, so tasks near
+ * the threshold do not flap.
+ */
+unsigned int sysctl_sched_ras_quarantine __read_mostly;
+unsigned int sysctl_sched_ras_racy_enter __read_mostly = 1000;  /* writes per second */
+unsigned int sysctl_sched_ras_racy_exit __read_mostly = 500;    /* writes per second */
+static struct cpumask ras_racy_cpus;
+
+/*
+ * Contention between RAS tasks: a task woken by another RAS task at least
+ * sched_ras_contention times (halved every second) is a lock handoff. It is
+ * woken on the waker's cpu, so the two do not contend from different cpus,
+ * and queued first to run the new lock holder soon. 0 turns it off, the
+ * contention is still counted.
+ */
+unsigned int sysctl_sched_ras_contention __read_mostly;
+
+/* the write rate of a task is measured over at least this many jiffies */
+#define RAS_RATE_WINDOW     (HZ / 10)
+
+/*
+ * Capacity of the cpus for asymmetric systems: sched_ras_cpu_capacity sets
+ * it per cpu, a cpu left at 0 keeps the cpu_power its sched domains gave it
+ * when it came online. Foreground tasks of long slices (the upper half of
+ * the weights) prefer the cpus of the highest capacity, background tasks
+ * those of the lowest. Capacities within RAS_CAPACITY_MARGIN percent count
+ * as equal, so the rt scaling of cpu_power does not split a symmetric
+ * system.
+ */
+#ifdef CONFIG_SMP
+#define RAS_CAPACITY_MARGIN 12
+
+static unsigned int ras_cpu_capacity[NR_CPUS];
+static unsigned long ras_domain_capacity[NR_CPUS];
+static struct cpumask ras_big_cpus, ras_little_cpus;
+static bool ras_asym_capacity __read_mostly;
+static DEFINE_RAW_SPINLOCK(ras_capacity_lock);
+#endif
+
+static unsigned int ras_period __read_mostly;
+static unsigned int ras_min_granularity __read_mostly = 1;
+static unsigned int ras_timeslice __read_mostly = RAS_TIMESLICE;
+static unsigned int ras_bg_timeslice __read_mostly = RAS_BG_TIMESLICE;
+static unsigned long ras_decay_period __read_mostly;
 
 /*
  * Get the task_struct according to sched_ras_entity.
@@ -29,6 +97,59 @@ static inline int on_ras_rq(struct sched_ras_entity *ras_se)
     return !list_empty(&ras_se->run_list);
 }
 
+#ifdef CONFIG_SMP
+
+/*
+ * The overloaded state of a ras_rq: more than one queued task, and at least
+ * one of them may run on another cpu.
+ */
+static inline void update_ras_migration(struct ras_rq *ras_rq)
+{
+    ras_rq->overloaded = ras_rq->ras_nr_migratory && ras_rq->ras_nr_running > 1;
+}
+
+static inline void inc_ras_migration(struct sched_ras_entity *ras_se, struct ras_rq *ras_rq)
+{
+    ras_rq->ras_nr_total++;
+    if (ras_se->nr_cpus_allowed > 1)
+        ras_rq->ras_nr_migratory++;
+
+    update_ras_migration(ras_rq);
+}
+
+static inline void dec_ras_migration(struct sched_ras_entity *ras_se, struct ras_rq *ras_rq)
+{
+    ras_rq->ras_nr_total--;
+    if (ras_se->nr_cpus_allowed > 1)
+        ras_rq->ras_nr_migratory--;
+
+    update_ras_migration(ras_rq);
+}
+
+#else
+
+static inline void inc_ras_migration(struct sched_ras_entity *ras_se, struct ras_rq *ras_rq)
+{
+}
+
+static inline void dec_ras_migration(struct sched_ras_entity *ras_se, struct ras_rq *ras_rq)
+{
+}
+
+#endif /* CONFIG_SMP */
+
+/*
+ * Index the weight bucket of p, the current task of rq, or remove rq from
+ * the index if p is NULL. See raspri.c.
+ */
+static inline void update_raspri_ras(struct rq *rq, struct task_struct *p)
+{
+#ifdef CONFIG_SMP
+    if (rq->online)
+        raspri_set(&rq->rd->raspri, cpu_of(rq), p ? raspri_bucket(p->ras.weight) : RASPRI_INVALID);
+#endif
+}
+
 /*
  * Update the current task's runtime statistics. Skip current tasks that
  * are not in our scheduling class.
@@ -77,293 +198,1532 @@ static char *task_group_path(struct task_group *tg)
 }
 
 /*
- * Update the time_slice of given task.
+ * One reference per traced task: the write fault hook and the write
+ * weighting are skipped entirely while no task is traced.
  */
-static void update_time_slice_ras(struct rq *rq, struct task_struct *p)
-{
-    struct sched_ras_entity *ras_se = &p->ras;
-    char *group_path;
-    int wcounts = p->wcounts;
-    int prob;
+struct static_key ras_trace_key = STATIC_KEY_INIT_FALSE;
 
-    group_path = task_group_path(p->sched_task_group);
+/* traced tasks that died, their references are dropped from a work item */
+static atomic_t ras_trace_exited = ATOMIC_INIT(0);
 
-    if (group_path[1] == 'b') /* background task */
-    {
-        ras_se->time_slice = RAS_BG_TIMESLICE;
-    }
-    else /* foreground task */
-    {
-        /* calculate weight */
-        if (wcounts == 0)
-        {
-            ras_se->weight = 10;
-        }
-        else
-        {
-            rq->ras.total_wcounts = rq->ras.total_wcounts - ras_se->old_wcounts + p->wcounts;
-            prob = wcounts / DIV_ROUND_UP(rq->ras.total_wcounts, 10);
-            ras_se->weight = prob == 10 ? 1 : 10 - prob;
-        }
+/*
+ * Take or drop a reference on ras_trace_key. May sleep.
+ */
+void ras_trace_get(void)
+{
+    static_key_slow_inc(&ras_trace_key);
+}
+EXPORT_SYMBOL_GPL(ras_trace_get);
 
-        ras_se->time_slice = RAS_TIMESLICE * ras_se->weight;
-        ras_se->old_wcounts = p->wcounts;
-    }
+void ras_trace_put(void)
+{
+    static_key_slow_dec(&ras_trace_key);
 }
+EXPORT_SYMBOL_GPL(ras_trace_put);
 
 /*
- * Initialize the ras run queue.
+ * Set the trace_flag of p and return whether it changed. The caller takes or
+ * drops the reference on ras_trace_key that goes with the change. Setting
+ * the flag of a new task before ras_trace_fork() overrides the inherited one.
  */
-void init_ras_rq(struct ras_rq *ras_rq, struct rq *rq)
+bool ras_trace_set(struct task_struct *p, bool on)
 {
-    INIT_LIST_HEAD(&ras_rq->run_list);
-    ras_rq->ras_nr_running = 0;
-    ras_rq->total_wcounts = 0;
+    bool changed;
+
+    task_lock(p);
+    changed = p->trace_flag != on;
+    p->trace_flag = on;
+    p->trace_inherit = false;
+    task_unlock(p);
+
+    return changed;
 }
+EXPORT_SYMBOL_GPL(ras_trace_set);
 
 /*
- * Adding a task to a ras run_list.
+ * Start tracing the page writes of p, return false if it already was.
+ * May sleep.
  */
-static void enqueue_task_ras(struct rq *rq, struct task_struct *p, int flags)
+bool ras_trace_start(struct task_struct *p)
 {
-    struct sched_ras_entity *ras_se = &p->ras;
-    int head = flags & ENQUEUE_HEAD;
+    /* switch the key on first so that no write of p is missed */
+    ras_trace_get();
+    if (ras_trace_set(p, true))
+        return true;
 
-    ras_se->old_wcounts = 0;
-    update_time_slice_ras(rq, p);
+    ras_trace_put();
+    return false;
+}
+EXPORT_SYMBOL_GPL(ras_trace_start);
 
-    if (head)
-        list_add(&ras_se->run_list, &(rq->ras.run_list));
-    else
-        list_add_tail(&ras_se->run_list, &(rq->ras.run_list));
+/*
+ * Stop tracing the page writes of p, return false if it was not traced.
+ * May sleep.
+ */
+bool ras_trace_stop(struct task_struct *p)
+{
+    if (!ras_trace_set(p, false))
+        return false;
 
-    ++rq->ras.ras_nr_running;
-    inc_nr_running(rq);
+    ras_trace_put();
+    return true;
+}
+EXPORT_SYMBOL_GPL(ras_trace_stop);
 
-    debug("enqueue_task_ras", rq, p);
+/*
+ * Whether the current task may read the page writes of p: the permission
+ * to read its /proc files.
+ */
+bool ras_may_read(struct task_struct *p)
+{
+    return ptrace_may_access(p, PTRACE_MODE_READ);
 }
+EXPORT_SYMBOL_GPL(ras_may_read);
 
 /*
- * Removing a task from a ras run_list.
+ * Sample the page writes of p since its counting started. Nothing is reset,
+ * so samplers cannot disturb each other: the writes of an interval are the
+ * difference of two samples. The counts are only written by p itself, with
+ * plain increments, and are read as they are. Reading them needs the
+ * permission to read the /proc files of p.
  */
-static void dequeue_task_ras(struct rq *rq, struct task_struct *p, int flags)
+int ras_trace_sample(struct task_struct *p, struct ras_trace_sample *s)
 {
-    struct sched_ras_entity *ras_se = &p->ras;
+    int i;
 
-    update_curr_ras(rq);
+    if (!ras_may_read(p))
+        return -EPERM;
 
-    list_del_init(&ras_se->run_list);
-    rq->ras.total_wcounts -= ras_se->old_wcounts;
-    --rq->ras.ras_nr_running;
+    s->pid = p->pid;
+    s->traced = ras_traced(p);
+    s->start_ns = p->ras_trace_stamp;
+    s->now_ns = ktime_to_ns(ktime_get());
 
-    dec_nr_running(rq);
+    s->wcounts = ACCESS_ONCE(p->wcounts);
+    for (i = 0; i < RAS_NR_WRITE_TYPES; i++)
+        s->wcounts_type[i] = ACCESS_ONCE(p->wcounts_type[i]);
 
-    debug("dequeue_task_ras", rq, p);
+    return 0;
 }
+EXPORT_SYMBOL_GPL(ras_trace_sample);
 
 /*
- * Put task to the head or the end of the run list without the overhead of
- * dequeue followed by enqueue.
+ * p is a new task of a traced parent and is about to run for the first time.
+ * The trace_flag is only set here, together with its reference: p can be
+ * found by pid before, and a fork that fails never gets here, so a flagged
+ * task always holds exactly one reference. May sleep.
  */
-static void requeue_task_ras(struct rq *rq, struct task_struct *p, int head)
+void ras_trace_fork(struct task_struct *p)
 {
+    bool inherit;
 
-    struct sched_ras_entity *ras_se = &p->ras;
-    struct list_head *queue = &(rq->ras.run_list);
+    ras_trace_get();
 
-    if (on_ras_rq(ras_se))
-    {
-        if (head)
-            list_move(&ras_se->run_list, queue);
-        else
-            list_move_tail(&ras_se->run_list, queue);
-    }
+    task_lock(p);
+    inherit = p->trace_inherit;
+    p->trace_inherit = false;
+    if (inherit)
+        p->trace_flag = true;
+    task_unlock(p);
 
-    debug("requeue_task_ras", rq, p);
+    /* start_trace() or stop_trace() on p came first */
+    if (!inherit)
+        ras_trace_put();
 }
 
-/*
- * Put task to the end of the run list without the overhead of
- * dequeue followed by enqueue.
- */
-static void yield_task_ras(struct rq *rq)
+static void ras_trace_exit_work(struct work_struct *work)
 {
-    requeue_task_ras(rq, rq->curr, 0);
+    while (atomic_add_unless(&ras_trace_exited, -1, 0))
+        ras_trace_put();
 }
 
+static DECLARE_WORK(ras_trace_work, ras_trace_exit_work);
+
 /*
- * Preempt the current task with a newly woken task if needed.
+ * Drop a reference on ras_trace_key from a work item, for callers that
+ * cannot sleep or hold locks that static_key_slow_dec() must not nest in.
  */
-static void check_preempt_curr_ras(struct rq *rq, struct task_struct *p, int flags)
+void ras_trace_put_deferred(void)
 {
-    /*
-     * There is nood need to implement this function.
-     */
+    atomic_inc(&ras_trace_exited);
+    schedule_work(&ras_trace_work);
 }
 
 /*
- * Pick the next task to run.
+ * p is dead. Called from finish_task_switch(), where we cannot sleep.
  */
-static struct task_struct *pick_next_task_ras(struct rq *rq)
+void ras_trace_exit(struct task_struct *p)
 {
-    struct sched_ras_entity *ras_se;
-    struct task_struct *p;
-    struct ras_rq *ras_rq;
+    if (likely(!p->trace_flag) || !ras_trace_set(p, false))
+        return;
 
-    ras_rq = &rq->ras;
+    ras_trace_put_deferred();
+}
 
-    if (ras_rq->ras_nr_running == 0)
-        return NULL;
+/*
+ * Classify a write fault that handle_mm_fault() resolved. do_wp_page()
+ * reports VM_FAULT_WRITE when it broke (or reused) a present read-only page,
+ * a write to a private file page that was not mapped yet is copied as well.
+ * Faults that failed or are retried are counted by their final attempt.
+ */
+void __ras_account_fault(struct task_struct *tsk, struct vm_area_struct *vma,
+                         unsigned int fault)
+{
+    int type;
 
-    ras_se = list_first_entry(&((rq->ras)).run_list, struct sched_ras_entity, run_list);
+    if (fault & (VM_FAULT_ERROR | VM_FAULT_RETRY))
+        return;
 
-    p = ras_task_of(ras_se);
-    p->se.exec_start = rq->clock_task;
+    if (vma->vm_flags & VM_SHARED)
+        type = RAS_WRITE_SHARED;
+    else if ((fault & VM_FAULT_WRITE) || vma->vm_file)
+        type = RAS_WRITE_COW;
+    else
+        type = RAS_WRITE_ANON;
 
-    return p;
+    ras_account_write(tsk, type);
 }
 
-static void put_prev_task_ras(struct rq *rq, struct task_struct *p)
+/*
+ * Write pressure notification of a task, registered by the ras_notify system
+ * call. Userspace is woken through an eventfd instead of polling get_trace.
+ */
+struct ras_notify
 {
-    update_curr_ras(rq);
-}
-
-#ifdef CONFIG_SMP
+    struct eventfd_ctx *ctx;
+    int wthreshold;             /* signal when wcounts reaches it, 0 disables */
+    int rate_threshold;         /* signal when writes per second reach it, 0 disables */
+    int flags;
+    unsigned long window_start; /* jiffies when the current rate window started */
+    int window_wcounts;         /* page writes in the current rate window */
+    bool rate_high;             /* the last window already reached rate_threshold */
+    int last_weight;            /* the weight userspace was last notified of */
+    struct irq_work work;       /* signals the eventfd outside of rq->lock */
+    struct rcu_head rcu;
+};
 
-static int select_task_rq_ras(struct task_struct *p, int sd_flag, int flags)
+/*
+ * The current task wakes p. Called from try_to_wake_up() under p->pi_lock.
+ * Only a futex handoff (WF_FUTEX, from wake_futex()) is contention: pipes,
+ * wait queues and timers wake tasks that did not block on the waker, and
+ * neither do wakeups from interrupts and by tasks outside SCHED_RAS.
+ */
+void ras_account_wakeup(struct task_struct *p, int wake_flags)
 {
-    struct task_struct *curr;
-    struct rq *rq;
-    int new_cpu, cpu, min, total_wcounts;
-
-    new_cpu = task_cpu(p);
-
-    if (p->rt.nr_cpus_allowed == 1)
-        goto out;
+    struct sched_ras_entity *ras_se = &p->ras;
+    struct ras_contender *c, *victim = NULL;
+    u64 now, wait = 0;
+    int i;
 
-    /* For anything but wake ups, just return the task_cpu */
-    if (sd_flag != SD_BALANCE_WAKE && sd_flag != SD_BALANCE_FORK)
-        goto out;
+    ras_se->contended = false;
+    if (!(wake_flags & WF_FUTEX) || in_interrupt() || current->policy != SCHED_RAS || current == p)
+        return;
 
-    rq = cpu_rq(cpu);
-    min = rq->ras.total_wcounts;
+    if (time_after(jiffies, ras_se->contention_stamp + HZ))
+    {
+        for (i = 0; i < RAS_NR_CONTENDERS; i++)
+            ras_se->contenders[i].count >>= 1;
+        ras_se->contention_stamp = jiffies;
+    }
 
-    rcu_read_lock();
+    now = local_clock();
+    if (ras_se->sleep_stamp && now > ras_se->sleep_stamp)
+        wait = now - ras_se->sleep_stamp;
 
-    for_each_online_cpu(cpu)
+    /* the entry of the waker, or the least frequent one is replaced */
+    for (i = 0; i < RAS_NR_CONTENDERS; i++)
     {
-        if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
-            continue;
-        rq = cpu_rq(cpu);
-        total_wcounts = rq->ras.total_wcounts;
-        if (total_wcounts < min)
-        {
-            min = total_wcounts;
-            new_cpu = cpu;
-        }
+        c = &ras_se->contenders[i];
+        if (c->pid == current->pid)
+            break;
+        if (!victim || c->count < victim->count)
+            victim = c;
+    }
+    if (i == RAS_NR_CONTENDERS)
+    {
+        c = victim;
+        c->pid = current->pid;
+        c->count = 0;
+        c->wait_ns = 0;
     }
+    c->count++;
+    c->wait_ns += wait;
 
-    rcu_read_unlock();
-    
-    printk("select_task_rq_ras:: pid: %d,pre_cpu: %d,new_cpu: %d\n",p->pid,task_cpu(p),new_cpu);
-out:
-    return new_cpu;
+    ras_se->waker_cpu = smp_processor_id();
+    ras_se->contended = sysctl_sched_ras_contention && c->count >= sysctl_sched_ras_contention;
 }
 
-static void set_cpus_allowed_ras(struct task_struct *p,
-                                 const struct cpumask *new_mask)
+/*
+ * Register the critical section flag of the current thread, or unregister
+ * it if cs is NULL. Only the address is kept: the tick reads the flag
+ * through the mapping of the thread itself, so it follows copy-on-write,
+ * munmap() and mremap() like any other access of the thread. A forked
+ * child and a new program image start unregistered.
+ */
+int ras_cs_register(struct ras_cs __user *cs)
 {
-}
+    if (cs)
+    {
+        if (!IS_ALIGNED((unsigned long)cs, sizeof(u32)))
+            return -EINVAL;
+        if (!access_ok(VERIFY_WRITE, cs, sizeof(*cs)))
+            return -EFAULT;
+    }
 
-static void rq_online_ras(struct rq *rq)
-{
+    current->ras.cs = cs;
+    return 0;
 }
+EXPORT_SYMBOL_GPL(ras_cs_register);
 
-static void rq_offline_ras(struct rq *rq)
+/*
+ * Whether the current task p flagged a critical section in its ras_cs,
+ * which then gets yield_pending set. Called from the tick of p, in its own
+ * context; a flag that is not mapped in reads as not set.
+ */
+static bool in_cs_ras(struct task_struct *p)
 {
-}
+    struct ras_cs __user *cs = p->ras.cs;
+    u32 in_cs;
+    bool ret;
 
-static void pre_schedule_ras(struct rq *rq, struct task_struct *prev)
-{
-}
+    if (!cs || p != current || !p->mm)
+        return false;
 
-static void post_schedule_ras(struct rq *rq)
-{
+    /* the tick cannot sleep, a fault fails instead of being handled */
+    pagefault_disable();
+    ret = !__get_user(in_cs, &cs->in_cs) && in_cs &&
+          !__put_user(1, &cs->yield_pending);
+    pagefault_enable();
+
+    return ret;
 }
 
-static void task_woken_ras(struct rq *rq, struct task_struct *p)
+/*
+ * Copy up to nr contenders of p into c, with the current wcounts of every
+ * contender, returns the number copied.
+ */
+int ras_get_contenders(struct task_struct *p, struct ras_contender *c, int nr)
 {
+    struct task_struct *t;
+    unsigned long flags;
+    int i;
+
+    nr = clamp(nr, 0, RAS_NR_CONTENDERS);
+
+    raw_spin_lock_irqsave(&p->pi_lock, flags);
+    memcpy(c, p->ras.contenders, nr * sizeof(*c));
+    raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+
+    /* the wakers are kept by their global pid */
+    rcu_read_lock();
+    for (i = 0; i < nr; i++)
+    {
+        t = c[i].pid ? pid_task(find_pid_ns(c[i].pid, &init_pid_ns), PIDTYPE_PID) : NULL;
+        c[i].wcounts = t ? ACCESS_ONCE(t->wcounts) : -1;
+    }
+    rcu_read_unlock();
+
+    return nr;
 }
+EXPORT_SYMBOL_GPL(ras_get_contenders);
 
-static void switched_from_ras(struct rq *rq, struct task_struct *p)
+static void ras_notify_work(struct irq_work *work)
 {
+    struct ras_notify *n = container_of(work, struct ras_notify, work);
+
+    eventfd_signal(n->ctx, 1);
 }
-#endif
 
-static void set_curr_task_ras(struct rq *rq)
+static void ras_notify_free(struct rcu_head *rcu)
 {
-    struct task_struct *p = rq->curr;
+    struct ras_notify *n = container_of(rcu, struct ras_notify, rcu);
 
-    /* set the start time of execution */
-    p->se.exec_start = rq->clock_task;
+    irq_work_sync(&n->work);
+    eventfd_ctx_put(n->ctx);
+    kfree(n);
 }
 
 /*
- * Update the running task's timeslice every 1ms.
+ * Register ctx to be signaled when the traced task p writes its wthreshold-th
+ * page, when its writes per second reach rate_threshold, or (with
+ * RAS_NOTIFY_WEIGHT) when its RAS weight changes. Every condition is edge
+ * triggered. On success the reference on ctx belongs to p. The caller must be
+ * allowed to read p's /proc files, as the notification reveals its writes.
  */
-static void task_tick_ras(struct rq *rq, struct task_struct *p, int queued)
+int ras_notify_register(struct task_struct *p, struct eventfd_ctx *ctx,
+                        int wthreshold, int rate_threshold, int flags)
 {
-    struct sched_ras_entity *ras_se = &p->ras;
-
-    update_curr_ras(rq);
+    struct ras_notify *n;
+    int ret = 0;
 
-    debug("task_tick_ras", rq, p);
+    if (!ptrace_may_access(p, PTRACE_MODE_READ))
+        return -EPERM;
 
-    /* Timeslice has not used up. */
-    if (--ras_se->time_slice)
-        return;
+    n = kzalloc(sizeof(*n), GFP_KERNEL);
+    if (!n)
+        return -ENOMEM;
 
-    update_time_slice_ras(rq, p);
+    n->ctx = ctx;
+    n->wthreshold = wthreshold;
+    n->rate_threshold = rate_threshold;
+    n->flags = flags;
+    n->window_start = jiffies;
+    n->last_weight = p->ras.weight;
+    init_irq_work(&n->work, ras_notify_work);
 
-    if (ras_se->run_list.prev != ras_se->run_list.next)
-    {
-        requeue_task_ras(rq, p, 0);
-        set_tsk_need_resched(p);
-        return;
-    }
+    /*
+     * The exit path takes task_lock() after setting PF_EXITING, and so does
+     * ras_notify_release() when p is dead: either p is not exiting yet and
+     * its release frees n, or n is not installed.
+     */
+    task_lock(p);
+    if (p->flags & PF_EXITING)
+        ret = -ESRCH;
+    else if (cmpxchg(&p->ras_notify, NULL, n)) /* only one registration per task */
+        ret = -EBUSY;
+    task_unlock(p);
+
+    if (ret)
+        kfree(n);
+    return ret;
 }
+EXPORT_SYMBOL_GPL(ras_notify_register);
 
 /*
- * Return the timeslice of a task.
+ * Drop the registration of p, if any. Called on unregistration and when p dies.
  */
-static unsigned int get_rr_interval_ras(struct rq *rq, struct task_struct *task)
+void ras_notify_release(struct task_struct *p)
 {
-    return task->ras.weight * RAS_TIMESLICE;
-}
+    struct ras_notify *n;
 
-static void prio_changed_ras(struct rq *rq, struct task_struct *p, int oldprio)
-{
+    task_lock(p);
+    n = xchg(&p->ras_notify, NULL);
+    task_unlock(p);
+
+    if (n)
+        call_rcu(&n->rcu, ras_notify_free);
 }
 
 /*
- * We switched to the sched_ras class.
+ * Drop the registration of p on behalf of the caller, who needs the same
+ * permission as for registering.
  */
-static void switched_to_ras(struct rq *rq, struct task_struct *p)
+int ras_notify_unregister(struct task_struct *p)
 {
-    if (!p->se.on_rq)
-        return;
+    if (!ptrace_may_access(p, PTRACE_MODE_READ))
+        return -EPERM;
 
-    if (rq->curr == p)
-        resched_task(rq->curr);
-    else
-        check_preempt_curr(rq, p, 0);
+    ras_notify_release(p);
+    return 0;
 }
+EXPORT_SYMBOL_GPL(ras_notify_unregister);
 
-const struct sched_class ras_sched_class = {
-    .next = &idle_sched_class,        /*Required*/
-    .enqueue_task = enqueue_task_ras, /*Required*/
+/*
+ * Called from the page fault path after a traced write of tsk(== current).
+ */
+void ras_notify_write(struct task_struct *tsk)
+{
+    struct ras_notify *n;
+    bool fire = false;
+
+    rcu_read_lock();
+
+    n = rcu_dereference(tsk->ras_notify);
+    if (!n)
+        goto out;
+
+    if (n->wthreshold && tsk->wcounts == n->wthreshold)
+        fire = true;
+
+    if (n->rate_threshold)
+    {
+        /* start a new window every second, re-arm once a window stays below */
+        if (time_after_eq(jiffies, n->window_start + HZ))
+        {
+            n->rate_high = n->window_wcounts >= n->rate_threshold &&
+                           time_before(jiffies, n->window_start + 2 * HZ);
+            n->window_start = jiffies;
+            n->window_wcounts = 0;
+        }
+
+        if (++n->window_wcounts == n->rate_threshold && !n->rate_high)
+            fire = true;
+    }
+
+    if (fire)
+        eventfd_signal(n->ctx, 1);
+
+out:
+    rcu_read_unlock();
+}
+
+/*
+ * Notify the weight change of p. rq->lock is held, so the eventfd (and the
+ * wakeup of the waiter) is signaled from irq_work.
+ */
+static void ras_notify_weight(struct task_struct *p)
+{
+    struct ras_notify *n;
+
+    rcu_read_lock();
+
+    n = rcu_dereference(p->ras_notify);
+    if (n && (n->flags & RAS_NOTIFY_WEIGHT) && n->last_weight != p->ras.weight)
+    {
+        n->last_weight = p->ras.weight;
+        irq_work_queue(&n->work);
+    }
+
+    rcu_read_unlock();
+}
+
+/*
+ * Scale wcounts by the write_scale attribute of the task.
+ */
+static inline int scale_wcounts_ras(struct sched_ras_entity *ras_se, int wcounts)
+{
+    if (likely(ras_se->write_scale == RAS_DEFAULT_WRITE_SCALE))
+        return wcounts;
+
+    return min_t(u64, div_u64((u64)wcounts * ras_se->write_scale, 100), INT_MAX);
+}
+
+/*
+ * Get the wcounts the weight of p is computed from. With a decay period, the
+ * writes older than a period count half, older than two periods a quarter...
+ */
+static int weight_wcounts_ras(struct task_struct *p)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+    unsigned long period = ras_decay_period;
+    unsigned long periods;
+    int wcounts;
+
+    /* nothing is traced, nobody has page writes to be weighted by */
+    if (!ras_tracing())
+        return 0;
+
+    wcounts = ras_wcounts(p);
+    if (!period)
+        return scale_wcounts_ras(ras_se, wcounts);
+
+    /* wcounts restarted from 0 by start_trace */
+    if (wcounts < ras_se->decay_base)
+        ras_se->decay_base = 0;
+
+    if (time_after_eq(jiffies, ras_se->decay_stamp + period))
+    {
+        periods = (jiffies - ras_se->decay_stamp) / period;
+        ras_se->decay_base = wcounts - ((wcounts - ras_se->decay_base) >> min(periods, 31UL));
+        ras_se->decay_stamp += periods * period;
+    }
+
+    return scale_wcounts_ras(ras_se, wcounts - ras_se->decay_base);
+}
+
+/*
+ * Get the slice of a task with the current weight of ras_se, in jiffies.
+ *
+ * Like CFS's sched_latency, every task queued on rq runs once per target
+ * period, for its share of the total weight, but at least for the minimum
+ * granularity. So the wakeup-to-run time stays bounded at any queue depth,
+ * and few tasks get long slices. Without a target period, the slice is
+ * ras_timeslice per unit of weight.
+ */
+static unsigned int slice_ras(struct rq *rq, struct sched_ras_entity *ras_se)
+{
+    unsigned long total_weight = rq->ras.total_weight;
+    unsigned int slice;
+
+    /* the products of the tunables would overflow on long periods */
+    if (!ras_period)
+        return min_t(u64, (u64)ras_timeslice * ras_se->weight, UINT_MAX);
+
+    if (!on_ras_rq(ras_se))
+        total_weight += ras_se->weight;
+    if (!total_weight)
+        return ras_period;
+
+    slice = min_t(u64, div64_u64((u64)ras_period * ras_se->weight, total_weight), ras_period);
+    return max(slice, ras_min_granularity);
+}
+
+/*
+ * Update the write rate of p and whether it belongs on the racy cpus.
+ */
+static void update_racy_ras(struct task_struct *p)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+    unsigned long elapsed = jiffies - ras_se->rate_stamp;
+    unsigned int rate = 0;
+    int wcounts;
+
+    if (elapsed < RAS_RATE_WINDOW)
+        return;
+
+    /* wcounts restarts from 0 with start_trace */
+    wcounts = ras_wcounts(p);
+    if (wcounts > ras_se->rate_base)
+        rate = min_t(u64, div_u64((u64)(wcounts - ras_se->rate_base) * HZ, elapsed), UINT_MAX);
+    ras_se->rate_base = wcounts;
+    ras_se->rate_stamp = jiffies;
+
+    if (!ras_se->racy && rate >= sysctl_sched_ras_racy_enter)
+        ras_se->racy = true;
+    else if (ras_se->racy && rate < min(sysctl_sched_ras_racy_exit, sysctl_sched_ras_racy_enter))
+        ras_se->racy = false;
+}
+
+/*
+ * Update the time_slice of given task.
+ */
+static void update_time_slice_ras(struct rq *rq, struct task_struct *p)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+    int min_weight = sysctl_sched_ras_min_weight;
+    int max_weight = sysctl_sched_ras_max_weight;
+    char *group_path;
+    int wcounts = weight_wcounts_ras(p);
+    int prob;
+
+    if (sysctl_sched_ras_quarantine)
+        update_racy_ras(p);
+
+    group_path = task_group_path(p->sched_task_group);
+    ras_se->background = group_path[1] == 'b';
+
+    if (ras_se->background)
+    {
+        ras_se->time_slice = ras_bg_timeslice;
+    }
+    else /* foreground task */
+    {
+        int old_weight = ras_se->weight;
+
+        rq->ras.total_wcounts = rq->ras.total_wcounts - ras_se->old_wcounts + wcounts;
+
+        /*
+         * calculate weight: the share of total_wcounts in tenths (prob)
+         * maps linearly from max_weight (0) down to min_weight (9 and 10)
+         */
+        if (wcounts == 0)
+        {
+            ras_se->weight = max_weight;
+        }
+        else
+        {
+            prob = wcounts / DIV_ROUND_UP(rq->ras.total_wcounts, 10);
+            ras_se->weight = max(min_weight, max_weight - prob * (max_weight - min_weight) / 9);
+        }
+
+        /* per-task attribute: static priority */
+        ras_se->weight = clamp(ras_se->weight + ras_se->priority, min_weight, max_weight);
+
+        /* a queued task's weight is part of total_weight */
+        if (on_ras_rq(ras_se))
+            rq->ras.total_weight += ras_se->weight - old_weight;
+
+        /* per-task attribute: latency sensitivity */
+        ras_se->time_slice = max(slice_ras(rq, ras_se) >> ras_se->latency, 1U);
+        ras_se->old_wcounts = wcounts;
+
+        if (ras_se->weight != old_weight)
+        {
+            ras_event(RAS_EVENT_WEIGHT, p, ras_se->weight);
+            if (rq->curr == p)
+                update_raspri_ras(rq, p);
+        }
+
+        if (unlikely(rcu_access_pointer(p->ras_notify)))
+            ras_notify_weight(p);
+    }
+}
+
+/*
+ * Check the cache line layout of the RAS fields at compile time, like pahole
+ * would: the hot fields of sched_ras_entity fit in one line, task_struct.ras
+ * starts a line so they stay in it, and the fields dirtied by write faults
+ * have a line of their own, after the scheduler ones.
+ */
+static inline void check_layout_ras(void)
+{
+    BUILD_BUG_ON(offsetof(struct sched_ras_entity, write_scale) + sizeof(int) > L1_CACHE_BYTES);
+#ifdef CONFIG_SMP
+    BUILD_BUG_ON(offsetof(struct task_struct, ras) % L1_CACHE_BYTES);
+    BUILD_BUG_ON(offsetof(struct task_struct, wcounts) % L1_CACHE_BYTES);
+    BUILD_BUG_ON(offsetof(struct task_struct, wcounts_type[RAS_NR_WRITE_TYPES]) -
+                 offsetof(struct task_struct, wcounts) > L1_CACHE_BYTES);
+    BUILD_BUG_ON(offsetof(struct task_struct, ras) + sizeof(struct sched_ras_entity) >
+                 offsetof(struct task_struct, wcounts));
+#endif
+}
+
+/*
+ * Initialize the ras run queue.
+ */
+void init_ras_rq(struct ras_rq *ras_rq, struct rq *rq)
+{
+    check_layout_ras();
+
+    INIT_LIST_HEAD(&ras_rq->run_list);
+    ras_rq->ras_nr_running = 0;
+    ras_rq->total_wcounts = 0;
+    ras_rq->total_weight = 0;
+#ifdef CONFIG_SMP
+    ras_rq->ras_nr_migratory = 0;
+    ras_rq->ras_nr_total = 0;
+    ras_rq->overloaded = 0;
+#endif
+}
+
+/*
+ * Check the bookkeeping of the ras run queue of cpu against its run_list:
+ * ras_nr_running, total_wcounts, total_weight and the migratory counts must
+ * match the queued tasks, which must be RAS tasks of this cpu with a sane
+ * time_slice. Used by the RAS self-test module, returns the number of broken
+ * invariants. The counts are taken under rq->lock and reported after it is
+ * released, rate limited, as the self-test checks in a loop.
+ */
+int ras_check_rq(int cpu)
+{
+    struct rq *rq = cpu_rq(cpu);
+    struct sched_ras_entity *ras_se;
+    struct task_struct *p;
+    unsigned long flags, nr = 0, weight = 0, migratory = 0;
+    unsigned long nr_running, total_weight, nr_migratory = 0, nr_total = 0;
+    long wcounts = 0;
+    int total_wcounts, errors = 0, bad_pid = 0, bad_slice_pid = 0;
+
+    raw_spin_lock_irqsave(&rq->lock, flags);
+
+    list_for_each_entry(ras_se, &rq->ras.run_list, run_list)
+    {
+        p = ras_task_of(ras_se);
+        nr++;
+        wcounts += ras_se->old_wcounts;
+        weight += ras_se->weight;
+        if (ras_se->nr_cpus_allowed > 1)
+            migratory++;
+
+        if (!p->on_rq || p->sched_class != &ras_sched_class || task_cpu(p) != cpu)
+        {
+            bad_pid = p->pid;
+            errors++;
+        }
+        if ((int)ras_se->time_slice <= 0)
+        {
+            bad_slice_pid = p->pid;
+            errors++;
+        }
+    }
+    nr_running = rq->ras.ras_nr_running;
+    total_wcounts = rq->ras.total_wcounts;
+    total_weight = rq->ras.total_weight;
+#ifdef CONFIG_SMP
+    nr_migratory = rq->ras.ras_nr_migratory;
+    nr_total = rq->ras.ras_nr_total;
+#endif
+
+    raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+    if (bad_pid)
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, pid: %d, not a queued RAS task of the cpu\n",
+                           cpu, bad_pid);
+    if (bad_slice_pid)
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, pid: %d, time_slice <= 0\n",
+                           cpu, bad_slice_pid);
+    if (nr != nr_running)
+    {
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, ras_nr_running: %lu, queued: %lu\n",
+                           cpu, nr_running, nr);
+        errors++;
+    }
+    if (wcounts != total_wcounts)
+    {
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, total_wcounts: %d, sum of old_wcounts: %ld\n",
+                           cpu, total_wcounts, wcounts);
+        errors++;
+    }
+    if (weight != total_weight)
+    {
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, total_weight: %lu, sum of weights: %lu\n",
+                           cpu, total_weight, weight);
+        errors++;
+    }
+
+#ifdef CONFIG_SMP
+    if (migratory != nr_migratory || nr != nr_total)
+    {
+        printk_ratelimited(KERN_ERR "ras_check_rq:: cpu: %d, ras_nr_migratory: %lu, migratory: %lu, ras_nr_total: %lu\n",
+                           cpu, nr_migratory, migratory, nr_total);
+        errors++;
+    }
+#endif
+
+    return errors;
+}
+EXPORT_SYMBOL_GPL(ras_check_rq);
+
+/*
+ * Adding a task to a ras run_list.
+ */
+static void enqueue_task_ras(struct rq *rq, struct task_struct *p, int flags)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+    int head = flags & ENQUEUE_HEAD;
+
+    /* latency sensitive tasks and lock handoffs run first after a wakeup */
+    if ((flags & ENQUEUE_WAKEUP) && (ras_se->latency || ras_se->contended))
+        head = 1;
+
+    ras_se->old_wcounts = 0;
+    update_time_slice_ras(rq, p);
+
+    if (head)
+        list_add(&ras_se->run_list, &(rq->ras.run_list));
+    else
+        list_add_tail(&ras_se->run_list, &(rq->ras.run_list));
+
+    ++rq->ras.ras_nr_running;
+    rq->ras.total_weight += ras_se->weight;
+    inc_ras_migration(ras_se, &rq->ras);
+    inc_nr_running(rq);
+
+    /* the queue grew, the running task must not exceed its new share */
+    if (ras_period && rq->curr != p && rq->curr->sched_class == &ras_sched_class)
+    {
+        struct sched_ras_entity *curr_se = &rq->curr->ras;
+
+        curr_se->time_slice = min(curr_se->time_slice,
+                                  max(slice_ras(rq, curr_se) >> curr_se->latency, 1U));
+    }
+
+    ras_event(RAS_EVENT_ENQUEUE, p, ras_se->time_slice);
+}
+
+/*
+ * Removing a task from a ras run_list.
+ */
+static void dequeue_task_ras(struct rq *rq, struct task_struct *p, int flags)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+
+    update_curr_ras(rq);
+
+    if (flags & DEQUEUE_SLEEP)
+        ras_se->sleep_stamp = local_clock();
+
+    list_del_init(&ras_se->run_list);
+    rq->ras.total_wcounts -= ras_se->old_wcounts;
+    rq->ras.total_weight -= ras_se->weight;
+    --rq->ras.ras_nr_running;
+    dec_ras_migration(ras_se, &rq->ras);
+
+    dec_nr_running(rq);
+
+    ras_event(RAS_EVENT_DEQUEUE, p, 0);
+}
+
+/*
+ * Put task to the head or the end of the run list without the overhead of
+ * dequeue followed by enqueue.
+ */
+static void requeue_task_ras(struct rq *rq, struct task_struct *p, int head)
+{
+
+    struct sched_ras_entity *ras_se = &p->ras;
+    struct list_head *queue = &(rq->ras.run_list);
+
+    if (on_ras_rq(ras_se))
+    {
+        if (head)
+            list_move(&ras_se->run_list, queue);
+        else
+            list_move_tail(&ras_se->run_list, queue);
+    }
+}
+
+/*
+ * Put task to the end of the run list without the overhead of
+ * dequeue followed by enqueue.
+ */
+static void yield_task_ras(struct rq *rq)
+{
+    struct task_struct *curr = rq->curr;
+
+    /* leaving a critical section after an extension, start a new slice */
+    if (curr->ras.slice_extended)
+    {
+        curr->ras.slice_extended = false;
+        update_time_slice_ras(rq, curr);
+    }
+
+    requeue_task_ras(rq, curr, 0);
+}
+
+/*
+ * Directed yield: the current task of rq donates the rest of its slice to
+ * p and p runs next on its cpu. Both run queues are locked. The slice of p
+ * is capped to the longest slice a task can get. The yielding task keeps
+ * the one tick a queued task needs, goes to the tail of its queue and only
+ * gets a new slice when that tick runs out.
+ */
+static bool yield_to_task_ras(struct rq *rq, struct task_struct *p, bool preempt)
+{
+    struct task_struct *curr = rq->curr;
+    unsigned int max_slice = ras_period ? ras_period :
+        min_t(u64, (u64)ras_timeslice * sysctl_sched_ras_max_weight, UINT_MAX);
+    unsigned int donated;
+
+    /* nothing left to give but the tick the yielder keeps */
+    if (!on_ras_rq(&p->ras) || curr->ras.time_slice <= 1)
+        return false;
+
+    donated = curr->ras.time_slice - 1;
+    curr->ras.time_slice -= donated;
+    p->ras.time_slice = min(p->ras.time_slice + donated, max(max_slice, 1U));
+    requeue_task_ras(task_rq(p), p, 1);
+
+    /* a slice extended for a critical section is given away as well */
+    curr->ras.slice_extended = false;
+    requeue_task_ras(rq, curr, 0);
+
+    return true;
+}
+
+/*
+ * Preempt the current task with a newly woken task if needed.
+ */
+static void check_preempt_curr_ras(struct rq *rq, struct task_struct *p, int flags)
+{
+    /* a more latency sensitive task was queued at the head, let it run */
+    if (p->ras.latency > rq->curr->ras.latency)
+    {
+        resched_task(rq->curr);
+        return;
+    }
+
+    /* a task writing less preempts a more write-heavy one, see raspri.c */
+    if (raspri_bucket(p->ras.weight) > raspri_bucket(rq->curr->ras.weight))
+    {
+        requeue_task_ras(rq, p, 1);
+        resched_task(rq->curr);
+    }
+}
+
+/*
+ * Pick the next task to run.
+ */
+static struct task_struct *pick_next_task_ras(struct rq *rq)
+{
+    struct sched_ras_entity *ras_se;
+    struct task_struct *p;
+    struct ras_rq *ras_rq;
+
+    ras_rq = &rq->ras;
+
+    if (ras_rq->ras_nr_running == 0)
+        return NULL;
+
+    ras_se = list_first_entry(&((rq->ras)).run_list, struct sched_ras_entity, run_list);
+
+    p = ras_task_of(ras_se);
+    p->se.exec_start = rq->clock_task;
+
+#ifdef CONFIG_SMP
+    /* look for tasks to move off the quarantine after the switch */
+    if (sysctl_sched_ras_quarantine && ras_rq->overloaded)
+        rq->post_schedule = 1;
+#endif
+
+    ras_event(RAS_EVENT_PICK, p, ras_se->time_slice);
+
+    return p;
+}
+
+static void put_prev_task_ras(struct rq *rq, struct task_struct *p)
+{
+    update_curr_ras(rq);
+
+    /* switched out while still runnable */
+    if (p->on_rq)
+        ras_event(RAS_EVENT_PREEMPT, p, p->ras.time_slice);
+}
+
+#ifdef CONFIG_SMP
+
+/* scratch cpumask of every cpu, used with interrupts disabled */
+static DEFINE_PER_CPU(cpumask_var_t, ras_local_mask);
+
+/*
+ * Get the cpus p may be placed on: the cpus allowed for p, narrowed to its
+ * side of the quarantine if that leaves any active cpu, or else to the
+ * active cpus of the other side.
+ */
+static const struct cpumask *allowed_cpus_ras(struct task_struct *p)
+{
+    struct cpumask *mask = __get_cpu_var(ras_local_mask);
+
+    if (!sysctl_sched_ras_quarantine || cpumask_empty(&ras_racy_cpus))
+        return tsk_cpus_allowed(p);
+
+    if (p->ras.racy)
+        cpumask_and(mask, tsk_cpus_allowed(p), &ras_racy_cpus);
+    else
+        cpumask_andnot(mask, tsk_cpus_allowed(p), &ras_racy_cpus);
+    cpumask_and(mask, mask, cpu_active_mask);
+
+    if (cpumask_empty(mask))
+        cpumask_and(mask, tsk_cpus_allowed(p), cpu_active_mask);
+    return mask;
+}
+
+/*
+ * Get the cpus of the capacity p prefers, or NULL if it has no preference
+ * or the system is symmetric.
+ */
+static const struct cpumask *capacity_cpus_ras(struct task_struct *p)
+{
+    if (!ras_asym_capacity)
+        return NULL;
+
+    if (p->ras.background)
+        return &ras_little_cpus;
+    if (p->ras.weight * 2 > (int)(sysctl_sched_ras_min_weight + sysctl_sched_ras_max_weight))
+        return &ras_big_cpus;
+
+    return NULL;
+}
+
+static unsigned long capacity_of_ras(int cpu)
+{
+    return ras_cpu_capacity[cpu] ? ras_cpu_capacity[cpu] : ras_domain_capacity[cpu];
+}
+
+/*
+ * Rebuild the big and little cpus from the capacity of every online cpu.
+ */
+static void update_capacity_ras(void)
+{
+    unsigned long capacity, min_capacity = ULONG_MAX, max_capacity = 0;
+    unsigned long flags;
+    int cpu;
+
+    raw_spin_lock_irqsave(&ras_capacity_lock, flags);
+
+    for_each_online_cpu(cpu)
+    {
+        capacity = capacity_of_ras(cpu);
+        min_capacity = min(min_capacity, capacity);
+        max_capacity = max(max_capacity, capacity);
+    }
+
+    cpumask_clear(&ras_big_cpus);
+    cpumask_clear(&ras_little_cpus);
+    for_each_online_cpu(cpu)
+    {
+        capacity = capacity_of_ras(cpu);
+        if (capacity * 100 >= max_capacity * (100 - RAS_CAPACITY_MARGIN))
+            cpumask_set_cpu(cpu, &ras_big_cpus);
+        if (capacity * 100 <= min_capacity * (100 + RAS_CAPACITY_MARGIN))
+            cpumask_set_cpu(cpu, &ras_little_cpus);
+    }
+    ras_asym_capacity = max_capacity * 100 > min_capacity * (100 + RAS_CAPACITY_MARGIN);
+
+    raw_spin_unlock_irqrestore(&ras_capacity_lock, flags);
+}
+
+/*
+ * Whether the queued task p is on the wrong side of the quarantine.
+ */
+static inline bool misplaced_ras(struct task_struct *p)
+{
+    if (!sysctl_sched_ras_quarantine || cpumask_empty(&ras_racy_cpus))
+        return false;
+
+    return p->ras.racy != cpumask_test_cpu(task_cpu(p), &ras_racy_cpus);
+}
+
+static inline bool usable_cpu_ras(int cpu, const struct cpumask *allowed,
+                                  const struct cpumask *preferred)
+{
+    return cpumask_test_cpu(cpu, allowed) && (!preferred || cpumask_test_cpu(cpu, preferred));
+}
+
+/*
+ * Find an idle cpu of allowed, and of preferred unless it is NULL, in the
+ * idle cpus of the root domain of prev_cpu: prev_cpu itself, then a cpu
+ * sharing its last level cache, then any other. Returns -1 if none of them
+ * is idle.
+ */
+static int select_idle_cpu_ras(const struct cpumask *allowed,
+                               const struct cpumask *preferred, int prev_cpu)
+{
+    struct cpumask *idle = cpu_rq(prev_cpu)->rd->ras_idle;
+    struct sched_domain *sd;
+    int cpu;
+
+    if (cpumask_empty(idle))
+        return -1;
+
+    if (cpumask_test_cpu(prev_cpu, idle) && usable_cpu_ras(prev_cpu, allowed, preferred))
+        return prev_cpu;
+
+    sd = rcu_dereference(per_cpu(sd_llc, prev_cpu));
+    if (sd)
+    {
+        for_each_cpu_and(cpu, sched_domain_span(sd), idle)
+        {
+            if (usable_cpu_ras(cpu, allowed, preferred))
+                return cpu;
+        }
+    }
+
+    for_each_cpu_and(cpu, idle, allowed)
+    {
+        if (usable_cpu_ras(cpu, allowed, preferred))
+            return cpu;
+    }
+
+    return -1;
+}
+
+static int select_task_rq_ras(struct task_struct *p, int sd_flag, int flags)
+{
+    const struct cpumask *allowed, *preferred;
+    struct rq *rq;
+    int new_cpu, cpu, min, total_wcounts;
+
+    new_cpu = task_cpu(p);
+
+    /* a pinned task has no choice */
+    if (p->ras.nr_cpus_allowed == 1)
+        goto out;
+
+    /* For anything but wake ups, just return the task_cpu */
+    if (sd_flag != SD_BALANCE_WAKE && sd_flag != SD_BALANCE_FORK)
+        goto out;
+
+    /* a lock handoff runs after its waker, on the waker's cpu */
+    if (sd_flag == SD_BALANCE_WAKE && p->ras.contended)
+    {
+        cpu = p->ras.waker_cpu;
+        if (cpumask_test_cpu(cpu, tsk_cpus_allowed(p)) && cpu_active(cpu))
+        {
+            new_cpu = cpu;
+            goto migrate;
+        }
+    }
+
+    rcu_read_lock();
+
+    allowed = allowed_cpus_ras(p);
+    preferred = capacity_cpus_ras(p);
+
+    /*
+     * an idle cpu runs p at once, one of the capacity p prefers if there is
+     * one, only scan the run queues if none is
+     */
+    cpu = -1;
+    if (preferred)
+        cpu = select_idle_cpu_ras(allowed, preferred, new_cpu);
+    if (cpu < 0)
+        cpu = select_idle_cpu_ras(allowed, NULL, new_cpu);
+    if (cpu >= 0)
+    {
+        rcu_read_unlock();
+        new_cpu = cpu;
+        goto migrate;
+    }
+
+    /* all cpus are busy, preempt the most write-heavy task that writes more than p */
+    cpu = raspri_find(&cpu_rq(new_cpu)->rd->raspri, p, allowed);
+    if (cpu >= 0)
+    {
+        rcu_read_unlock();
+        new_cpu = cpu;
+        goto migrate;
+    }
+
+    /* only leave the current cpu if that saves more than the migration cost */
+    rq = cpu_rq(new_cpu);
+    min = rq->ras.total_wcounts - (int)sysctl_sched_ras_migration_cost;
+    if (!cpumask_test_cpu(new_cpu, allowed))
+        min = INT_MAX;
+
+    for_each_cpu_and(cpu, allowed, cpu_online_mask)
+    {
+        rq = cpu_rq(cpu);
+        total_wcounts = rq->ras.total_wcounts;
+        if (total_wcounts < min)
+        {
+            min = total_wcounts;
+            new_cpu = cpu;
+        }
+    }
+
+    rcu_read_unlock();
+
+migrate:
+    if (new_cpu != task_cpu(p))
+        ras_event(RAS_EVENT_MIGRATE, p, new_cpu);
+out:
+    return new_cpu;
+}
+
+/*
+ * The affinity of p changes, called before ras.nr_cpus_allowed is updated.
+ * A queued task that becomes pinned or free changes the migratory count of
+ * its run queue, whose lock is held.
+ */
+static void set_cpus_allowed_ras(struct task_struct *p,
+                                 const struct cpumask *new_mask)
+{
+    struct ras_rq *ras_rq;
+    int weight = cpumask_weight(new_mask);
+
+    if (!on_ras_rq(&p->ras) || (weight > 1) == (p->ras.nr_cpus_allowed > 1))
+        return;
+
+    ras_rq = &task_rq(p)->ras;
+    if (weight > 1)
+        ras_rq->ras_nr_migratory++;
+    else
+        ras_rq->ras_nr_migratory--;
+
+    update_ras_migration(ras_rq);
+}
+
+/*
+ * rq joins a root domain, index its cpu in the RAS state of the domain.
+ */
+static void rq_online_ras(struct rq *rq)
+{
+    ras_domain_capacity[rq->cpu] = rq->cpu_power;
+    update_capacity_ras();
+
+    update_ras_migration(&rq->ras);
+
+    if (rq->curr == rq->idle)
+        cpumask_set_cpu(rq->cpu, rq->rd->ras_idle);
+    if (rq->curr->sched_class == &ras_sched_class)
+        update_raspri_ras(rq, rq->curr);
+}
+
+/*
+ * Find the least loaded active cpu other than this_cpu, by queued RAS tasks
+ * and then by their wcounts. Returns -1 if there is none.
+ */
+static int find_drain_cpu_ras(int this_cpu)
+{
+    unsigned long nr, min_nr = ULONG_MAX;
+    int cpu, target = -1, min_wcounts = INT_MAX;
+
+    for_each_cpu(cpu, cpu_active_mask)
+    {
+        if (cpu == this_cpu)
+            continue;
+
+        nr = cpu_rq(cpu)->ras.ras_nr_running;
+        if (nr < min_nr || (nr == min_nr && cpu_rq(cpu)->ras.total_wcounts < min_wcounts))
+        {
+            min_nr = nr;
+            min_wcounts = cpu_rq(cpu)->ras.total_wcounts;
+            target = cpu;
+        }
+    }
+
+    return target;
+}
+
+/*
+ * Move the queued RAS tasks off the dying cpu of rq, up to RAS_DRAIN_BATCH
+ * at a time to the least loaded active cpu, instead of leaving all of them
+ * to migrate_tasks(), which puts them on the first allowed cpu. Called by
+ * migrate_tasks() on CPU_DYING, with rq->lock held while the other cpus are
+ * stopped. The tasks that are not allowed on any chosen cpu are left to
+ * migrate_tasks().
+ */
+#define RAS_DRAIN_BATCH     4
+
+void drain_offline_ras_rq(struct rq *rq)
+{
+    struct sched_ras_entity *ras_se, *next;
+    struct task_struct *p;
+    struct rq *dest_rq;
+    int dest_cpu, moved;
+
+    while (rq->ras.ras_nr_running)
+    {
+        dest_cpu = find_drain_cpu_ras(cpu_of(rq));
+        if (dest_cpu < 0)
+            break;
+
+        dest_rq = cpu_rq(dest_cpu);
+        double_lock_balance(rq, dest_rq);
+
+        moved = 0;
+        list_for_each_entry_safe(ras_se, next, &rq->ras.run_list, run_list)
+        {
+            p = ras_task_of(ras_se);
+            if (task_running(rq, p) || !cpumask_test_cpu(dest_cpu, tsk_cpus_allowed(p)))
+                continue;
+
+            deactivate_task(rq, p, 0);
+            set_task_cpu(p, dest_cpu);
+            activate_task(dest_rq, p, 0);
+            ras_event(RAS_EVENT_MIGRATE, p, dest_cpu);
+
+            if (++moved == RAS_DRAIN_BATCH)
+                break;
+        }
+
+        if (moved)
+            resched_task(dest_rq->curr);
+        double_unlock_balance(rq, dest_rq);
+
+        if (!moved)
+            break;
+    }
+}
+
+/*
+ * rq leaves its root domain: because its cpu is going down, or because the
+ * sched domains are rebuilt, in which case rq_online_ras() follows at once
+ * for the new root domain. The queued tasks stay, a dying cpu is drained
+ * by drain_offline_ras_rq().
+ */
+static void rq_offline_ras(struct rq *rq)
+{
+    update_capacity_ras();
+
+    cpumask_clear_cpu(rq->cpu, rq->rd->ras_idle);
+    raspri_set(&rq->rd->raspri, rq->cpu, RASPRI_INVALID);
+}
+
+static void pre_schedule_ras(struct rq *rq, struct task_struct *prev)
+{
+}
+
+/*
+ * Move a queued task of rq that is on the wrong side of the quarantine to
+ * the least loaded cpu of its side. Returns whether a task was moved.
+ */
+static bool push_misplaced_ras(struct rq *rq)
+{
+    struct sched_ras_entity *ras_se;
+    const struct cpumask *allowed;
+    struct task_struct *p = NULL;
+    struct rq *lowest_rq;
+    unsigned long nr, min = ULONG_MAX;
+    bool moved = false;
+    int cpu, target = -1;
+
+    list_for_each_entry(ras_se, &rq->ras.run_list, run_list)
+    {
+        if (ras_se->nr_cpus_allowed > 1 && ras_task_of(ras_se) != rq->curr &&
+            misplaced_ras(ras_task_of(ras_se)))
+        {
+            p = ras_task_of(ras_se);
+            break;
+        }
+    }
+    if (!p)
+        return false;
+
+    allowed = allowed_cpus_ras(p);
+    for_each_cpu_and(cpu, allowed, cpu_active_mask)
+    {
+        nr = cpu_rq(cpu)->ras.ras_nr_running;
+        if (nr < min)
+        {
+            min = nr;
+            target = cpu;
+        }
+    }
+
+    /* p cannot run on its side of the quarantine, leave it where it is */
+    if (target < 0 || p->ras.racy != cpumask_test_cpu(target, &ras_racy_cpus))
+        return false;
+
+    lowest_rq = cpu_rq(target);
+    get_task_struct(p);
+    double_lock_balance(rq, lowest_rq);
+
+    /* rq->lock may have been dropped, p may have run, moved or changed */
+    if (task_cpu(p) == cpu_of(rq) && p->on_rq && !task_running(rq, p) &&
+        p->sched_class == &ras_sched_class && cpumask_test_cpu(target, tsk_cpus_allowed(p)) &&
+        cpu_active(target))
+    {
+        deactivate_task(rq, p, 0);
+        set_task_cpu(p, target);
+        activate_task(lowest_rq, p, 0);
+        ras_event(RAS_EVENT_MIGRATE, p, target);
+        check_preempt_curr(lowest_rq, p, 0);
+        moved = true;
+    }
+
+    double_unlock_balance(rq, lowest_rq);
+    put_task_struct(p);
+
+    return moved;
+}
+
+/* the most tasks moved off a cpu after one schedule */
+#define RAS_PUSH_BATCH      4
+
+/*
+ * Push the queued tasks on the wrong side of the quarantine away, a few
+ * after every schedule. A running task moves when it is preempted or at its
+ * next wakeup.
+ */
+static void post_schedule_ras(struct rq *rq)
+{
+    int i;
+
+    for (i = 0; i < RAS_PUSH_BATCH; i++)
+    {
+        if (!push_misplaced_ras(rq))
+            break;
+    }
+}
+
+static void task_woken_ras(struct rq *rq, struct task_struct *p)
+{
+}
+
+static void switched_from_ras(struct rq *rq, struct task_struct *p)
+{
+    /* the running task left the class */
+    if (rq->curr == p)
+        update_raspri_ras(rq, NULL);
+}
+#endif
+
+static void set_curr_task_ras(struct rq *rq)
+{
+    struct task_struct *p = rq->curr;
+
+    /* set the start time of execution */
+    p->se.exec_start = rq->clock_task;
+
+    update_raspri_ras(rq, p);
+}
+
+/*
+ * Update the running task's timeslice every 1ms.
+ */
+#ifdef CONFIG_RT_MUTEXES
+/*
+ * Whether a SCHED_RAS task waits for an rt_mutex held by p. The waiters
+ * are protected by p->pi_lock, which nests outside of the rq->lock held
+ * here, so it is only tried.
+ */
+static bool blocks_ras_waiter(struct task_struct *p)
+{
+    struct rt_mutex_waiter *waiter;
+    bool blocks = false;
+
+    if (plist_head_empty(&p->pi_waiters) || !raw_spin_trylock(&p->pi_lock))
+        return false;
+
+    plist_for_each_entry(waiter, &p->pi_waiters, pi_list_entry)
+    {
+        if (waiter->task->policy == SCHED_RAS)
+        {
+            blocks = true;
+            break;
+        }
+    }
+
+    raw_spin_unlock(&p->pi_lock);
+    return blocks;
+}
+#else
+static inline bool blocks_ras_waiter(struct task_struct *p)
+{
+    return false;
+}
+#endif
+
+static void task_tick_ras(struct rq *rq, struct task_struct *p, int queued)
+{
+    struct sched_ras_entity *ras_se = &p->ras;
+
+    update_curr_ras(rq);
+
+    /* Timeslice has not used up. */
+    if (--ras_se->time_slice)
+        return;
+
+    /*
+     * One more min_granularity, once per slice, to leave a critical section
+     * instead of being queued behind the tasks waiting for it: for a thread
+     * that flagged one in its ras_cs, and for the holder of an rt_mutex RAS
+     * tasks wait for, as tasks of the same priority do not boost each other.
+     */
+    if (!ras_se->slice_extended && (in_cs_ras(p) || blocks_ras_waiter(p)))
+    {
+        ras_se->slice_extended = true;
+        ras_se->time_slice = ras_min_granularity;
+        return;
+    }
+    ras_se->slice_extended = false;
+
+    update_time_slice_ras(rq, p);
+
+    ras_event(RAS_EVENT_EXPIRE, p, ras_se->time_slice);
+
+    if (ras_se->run_list.prev != ras_se->run_list.next)
+    {
+        requeue_task_ras(rq, p, 0);
+        set_tsk_need_resched(p);
+        return;
+    }
+}
+
+/*
+ * Return the timeslice of a task.
+ */
+static unsigned int get_rr_interval_ras(struct rq *rq, struct task_struct *task)
+{
+    return max(slice_ras(rq, &task->ras) >> task->ras.latency, 1U);
+}
+
+static void prio_changed_ras(struct rq *rq, struct task_struct *p, int oldprio)
+{
+}
+
+/*
+ * We switched to the sched_ras class.
+ */
+static void switched_to_ras(struct rq *rq, struct task_struct *p)
+{
+    if (!p->on_rq)
+        return;
+
+    if (rq->curr == p)
+        resched_task(rq->curr);
+    else
+        check_preempt_curr(rq, p, 0);
+}
+
+void __init init_sched_ras_class(void)
+{
+#ifdef CONFIG_SMP
+    unsigned int i;
+
+    for_each_possible_cpu(i)
+        zalloc_cpumask_var_node(&per_cpu(ras_local_mask, i), GFP_KERNEL, cpu_to_node(i));
+#endif
+}
+
+const struct sched_class ras_sched_class = {
+    .next = &idle_sched_class,        /*Required*/
+    .enqueue_task = enqueue_task_ras, /*Required*/
     .dequeue_task = dequeue_task_ras, /*Required*/
     .yield_task = yield_task_ras,     /*Required*/
+    .yield_to_task = yield_to_task_ras,
 
     .check_preempt_curr = check_preempt_curr_ras, /*Required*/
 
@@ -390,3 +1750,437 @@ const struct sched_class ras_sched_class = {
     .prio_changed = prio_changed_ras, /*Never need impl */
     .switched_to = switched_to_ras,   /*Required*/
 };
+
+/*
+ * Presets setting several tunables at once, chosen by writing their name to
+ * /proc/sys/kernel/sched_ras_preset.
+ */
+struct ras_preset
+{
+    const char *name;
+    unsigned int latency;
+    unsigned int min_granularity;
+    unsigned int timeslice;
+    unsigned int bg_timeslice;
+    unsigned int min_weight;
+    unsigned int max_weight;
+    unsigned int decay_period;
+    unsigned int migration_cost;
+};
+
+static const struct ras_preset ras_presets[] = {
+    /* name          period gran slice  bg  min max decay cost */
+    {"default",      100,   2,   10,    5,  1,  10, 0,    0},
+    {"throughput",   400,   10,  20,    10, 2,  10, 1000, 10},
+    {"latency",      20,    1,   2,     1,  1,  5,  200,  0},
+};
+
+static DEFINE_MUTEX(ras_sysctl_mutex);
+static char ras_preset_name[16] = "default";
+static unsigned int ras_sysctl_zero;
+static unsigned int ras_sysctl_one = 1;
+static unsigned int ras_sysctl_max_weight = 100;
+
+/*
+ * proc_dointvec_minmax() for one unsigned int, which 3.4 does not have: a
+ * negative value or one past UINT_MAX is refused instead of being stored
+ * with its sign reinterpreted, and the bounds in extra1 and extra2 are
+ * unsigned int as well.
+ */
+static int proc_douintvec_minmax_ras(struct ctl_table *table, int write,
+                                     void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    unsigned int min = table->extra1 ? *(unsigned int *)table->extra1 : 0;
+    unsigned int max = table->extra2 ? *(unsigned int *)table->extra2 : UINT_MAX;
+    unsigned int *data = table->data;
+    struct ctl_table tmp = *table;
+    unsigned long val;
+    char buf[24];
+    int ret;
+
+    tmp.data = buf;
+    tmp.maxlen = sizeof(buf);
+    if (!write)
+    {
+        snprintf(buf, sizeof(buf), "%u", *data);
+        return proc_dostring(&tmp, write, buffer, lenp, ppos);
+    }
+
+    ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+    if (ret)
+        return ret;
+
+    /* kstrtoul() takes no sign */
+    ret = kstrtoul(strim(buf), 0, &val);
+    if (ret)
+        return ret;
+    if (val < min || val > max)
+        return -EINVAL;
+
+    *data = val;
+    return 0;
+}
+
+/* convert the tunables in ms to the jiffies read on the hot paths */
+static void update_sysctl_ras(void)
+{
+    ras_period = msecs_to_jiffies(sysctl_sched_ras_latency);
+    ras_min_granularity = max(msecs_to_jiffies(sysctl_sched_ras_min_granularity), 1UL);
+    ras_timeslice = max(msecs_to_jiffies(sysctl_sched_ras_timeslice), 1UL);
+    ras_bg_timeslice = max(msecs_to_jiffies(sysctl_sched_ras_bg_timeslice), 1UL);
+    ras_decay_period = msecs_to_jiffies(sysctl_sched_ras_decay_period);
+}
+
+/*
+ * The weight buckets of raspri are fractions of sched_ras_max_weight. When
+ * it changes, index the current task of every cpu again, so raspri_find
+ * does not compare the buckets of a task against those of the old bound.
+ */
+static void rebuild_raspri_ras(void)
+{
+#ifdef CONFIG_SMP
+    unsigned long flags;
+    struct rq *rq;
+    int cpu;
+
+    get_online_cpus();
+    for_each_online_cpu(cpu)
+    {
+        rq = cpu_rq(cpu);
+        raw_spin_lock_irqsave(&rq->lock, flags);
+        if (rq->curr->sched_class == &ras_sched_class)
+            update_raspri_ras(rq, rq->curr);
+        raw_spin_unlock_irqrestore(&rq->lock, flags);
+    }
+    put_online_cpus();
+#endif
+}
+
+static int sched_ras_sysctl_handler(struct ctl_table *table, int write,
+                                    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    int ret;
+
+    mutex_lock(&ras_sysctl_mutex);
+    ret = proc_douintvec_minmax_ras(table, write, buffer, lenp, ppos);
+    if (!ret && write)
+    {
+        update_sysctl_ras();
+        strlcpy(ras_preset_name, "custom", sizeof(ras_preset_name));
+    }
+    mutex_unlock(&ras_sysctl_mutex);
+
+    return ret;
+}
+
+static int sched_ras_weight_handler(struct ctl_table *table, int write,
+                                    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    unsigned int old_min = sysctl_sched_ras_min_weight;
+    unsigned int old_max = sysctl_sched_ras_max_weight;
+    int ret;
+
+    mutex_lock(&ras_sysctl_mutex);
+    ret = proc_douintvec_minmax_ras(table, write, buffer, lenp, ppos);
+    if (!ret && write && sysctl_sched_ras_min_weight > sysctl_sched_ras_max_weight)
+    {
+        sysctl_sched_ras_min_weight = old_min;
+        sysctl_sched_ras_max_weight = old_max;
+        ret = -EINVAL;
+    }
+    else if (!ret && write)
+    {
+        if (sysctl_sched_ras_max_weight != old_max)
+            rebuild_raspri_ras();
+        strlcpy(ras_preset_name, "custom", sizeof(ras_preset_name));
+    }
+    mutex_unlock(&ras_sysctl_mutex);
+
+    return ret;
+}
+
+static int sched_ras_racy_cpus_handler(struct ctl_table *table, int write,
+                                       void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    struct ctl_table tmp = *table;
+    cpumask_var_t mask;
+    char buf[128];
+    int ret;
+
+    if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+        return -ENOMEM;
+
+    mutex_lock(&ras_sysctl_mutex);
+
+    tmp.data = buf;
+    tmp.maxlen = sizeof(buf);
+    if (!write)
+    {
+        cpulist_scnprintf(buf, sizeof(buf), &ras_racy_cpus);
+        ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+        goto out;
+    }
+
+    ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+    if (!ret)
+        ret = cpulist_parse(strim(buf), mask);
+    if (!ret)
+        cpumask_copy(&ras_racy_cpus, mask);
+
+out:
+    mutex_unlock(&ras_sysctl_mutex);
+    free_cpumask_var(mask);
+    return ret;
+}
+
+#ifdef CONFIG_SMP
+/*
+ * The capacity of every possible cpu, separated by spaces. Cpus left out
+ * of a write are reset to 0, the capacity from their sched domains.
+ */
+static int sched_ras_cpu_capacity_handler(struct ctl_table *table, int write,
+                                          void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    unsigned int *capacity = NULL;
+    struct ctl_table tmp = *table;
+    char buf[256], *s, *tok;
+    int cpu, len = 0, ret;
+
+    mutex_lock(&ras_sysctl_mutex);
+
+    tmp.data = buf;
+    tmp.maxlen = sizeof(buf);
+    if (!write)
+    {
+        buf[0] = '\0';
+        for_each_possible_cpu(cpu)
+            len += scnprintf(buf + len, sizeof(buf) - len, "%s%u", len ? " " : "", ras_cpu_capacity[cpu]);
+        ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+        goto out;
+    }
+
+    ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+    if (ret)
+        goto out;
+
+    /* NR_CPUS entries would not fit on the stack, cpus not listed get 0 */
+    capacity = kcalloc(nr_cpu_ids, sizeof(*capacity), GFP_KERNEL);
+    if (!capacity)
+    {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    s = strim(buf);
+    cpu = 0;
+    while ((tok = strsep(&s, " ,")) != NULL)
+    {
+        if (!*tok)
+            continue;
+        if (cpu >= nr_cpu_ids)
+        {
+            ret = -EINVAL;
+            goto out;
+        }
+        ret = kstrtouint(tok, 0, &capacity[cpu++]);
+        if (ret)
+            goto out;
+    }
+
+    memcpy(ras_cpu_capacity, capacity, nr_cpu_ids * sizeof(*capacity));
+    update_capacity_ras();
+
+out:
+    mutex_unlock(&ras_sysctl_mutex);
+    kfree(capacity);
+    return ret;
+}
+#endif
+
+static int sched_ras_preset_handler(struct ctl_table *table, int write,
+                                    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    const struct ras_preset *preset;
+    char name[sizeof(ras_preset_name)];
+    struct ctl_table tmp = *table;
+    int i, ret;
+
+    mutex_lock(&ras_sysctl_mutex);
+
+    if (!write)
+    {
+        ret = proc_dostring(table, write, buffer, lenp, ppos);
+        goto out;
+    }
+
+    tmp.data = name;
+    ret = proc_dostring(&tmp, write, buffer, lenp, ppos);
+    if (ret)
+        goto out;
+
+    ret = -EINVAL;
+    for (i = 0; i < ARRAY_SIZE(ras_presets); i++)
+    {
+        preset = &ras_presets[i];
+        if (strcmp(strim(name), preset->name))
+            continue;
+
+        sysctl_sched_ras_latency = preset->latency;
+        sysctl_sched_ras_min_granularity = preset->min_granularity;
+        sysctl_sched_ras_timeslice = preset->timeslice;
+        sysctl_sched_ras_bg_timeslice = preset->bg_timeslice;
+        sysctl_sched_ras_min_weight = preset->min_weight;
+        if (sysctl_sched_ras_max_weight != preset->max_weight)
+        {
+            sysctl_sched_ras_max_weight = preset->max_weight;
+            rebuild_raspri_ras();
+        }
+        sysctl_sched_ras_decay_period = preset->decay_period;
+        sysctl_sched_ras_migration_cost = preset->migration_cost;
+        update_sysctl_ras();
+        strlcpy(ras_preset_name, preset->name, sizeof(ras_preset_name));
+        ret = 0;
+        break;
+    }
+
+out:
+    mutex_unlock(&ras_sysctl_mutex);
+    return ret;
+}
+
+static struct ctl_table sched_ras_sysctls[] = {
+    {
+        .procname = "sched_ras_latency_ms",
+        .data = &sysctl_sched_ras_latency,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_min_granularity_ms",
+        .data = &sysctl_sched_ras_min_granularity,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_one,
+    },
+    {
+        .procname = "sched_ras_timeslice_ms",
+        .data = &sysctl_sched_ras_timeslice,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_one,
+    },
+    {
+        .procname = "sched_ras_bg_timeslice_ms",
+        .data = &sysctl_sched_ras_bg_timeslice,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_one,
+    },
+    {
+        .procname = "sched_ras_min_weight",
+        .data = &sysctl_sched_ras_min_weight,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_weight_handler,
+        .extra1 = &ras_sysctl_one,
+        .extra2 = &ras_sysctl_max_weight,
+    },
+    {
+        .procname = "sched_ras_max_weight",
+        .data = &sysctl_sched_ras_max_weight,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_weight_handler,
+        .extra1 = &ras_sysctl_one,
+        .extra2 = &ras_sysctl_max_weight,
+    },
+    {
+        .procname = "sched_ras_decay_period_ms",
+        .data = &sysctl_sched_ras_decay_period,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_migration_cost",
+        .data = &sysctl_sched_ras_migration_cost,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = sched_ras_sysctl_handler,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_quarantine",
+        .data = &sysctl_sched_ras_quarantine,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = proc_douintvec_minmax_ras,
+        .extra1 = &ras_sysctl_zero,
+        .extra2 = &ras_sysctl_one,
+    },
+    {
+        .procname = "sched_ras_racy_enter",
+        .data = &sysctl_sched_ras_racy_enter,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = proc_douintvec_minmax_ras,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_racy_exit",
+        .data = &sysctl_sched_ras_racy_exit,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = proc_douintvec_minmax_ras,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_contention",
+        .data = &sysctl_sched_ras_contention,
+        .maxlen = sizeof(unsigned int),
+        .mode = 0644,
+        .proc_handler = proc_douintvec_minmax_ras,
+        .extra1 = &ras_sysctl_zero,
+    },
+    {
+        .procname = "sched_ras_racy_cpus",
+        .maxlen = 128,
+        .mode = 0644,
+        .proc_handler = sched_ras_racy_cpus_handler,
+    },
+#ifdef CONFIG_SMP
+    {
+        .procname = "sched_ras_cpu_capacity",
+        .maxlen = 256,
+        .mode = 0644,
+        .proc_handler = sched_ras_cpu_capacity_handler,
+    },
+#endif
+    {
+        .procname = "sched_ras_preset",
+        .data = ras_preset_name,
+        .maxlen = sizeof(ras_preset_name),
+        .mode = 0644,
+        .proc_handler = sched_ras_preset_handler,
+    },
+    {}
+};
+
+static struct ctl_path sched_ras_path[] = {
+    {.procname = "kernel"},
+    {}
+};
+
+static int __init init_sysctl_ras(void)
+{
+    update_sysctl_ras();
+    register_sysctl_paths(sched_ras_path, sched_ras_sysctls);
+    return 0;
+}
+late_initcall(init_sysctl_ras);
@@ -0,0 +1,151 @@
+/*
+ * Race-Averse Scheduling (RAS) event buffers
+ *
+ * Every cpu records compact binary RAS events (enqueue, pick, preempt, expire,
+ * migrate, weight change and write bursts) into its own ring buffer. Only the
+ * owning cpu writes its buffer, with interrupts disabled, so no lock is taken.
+ * The buffers are mapped read-only by userspace collectors through
+ * /proc/ras_events/cpu<N>, and events are only recorded while one of these
+ * files is open.
+ *
+ * Layout of a buffer (RAS_EVENT_HDR_SIZE + RAS_EVENT_DATA_SIZE bytes):
+ *   page 0:  struct ras_event_header
+ *   page 1-: struct ras_event[RAS_EVENT_NR], indexed by head % RAS_EVENT_NR
+ *
+ * A collector remembers its tail, reads events [tail, head) after reading
+ * head (head is published after the event with smp_wmb()), and has lost
+ * events if head - tail exceeds RAS_EVENT_NR.
+ */
+
+#include "sched.h"
+
+#include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+
+#define RAS_EVENT_PAGES     16
+#define RAS_EVENT_HDR_SIZE  PAGE_SIZE
+#define RAS_EVENT_DATA_SIZE (RAS_EVENT_PAGES * PAGE_SIZE)
+#define RAS_EVENT_NR        (RAS_EVENT_DATA_SIZE / sizeof(struct ras_event))
+
+struct ras_event
+{
+    u64 time;   /* local_clock() in ns */
+    s32 pid;
+    u16 type;   /* enum ras_event_type */
+    u16 arg;
+};
+
+struct ras_event_header
+{
+    u32 head;       /* number of events ever written, wraps */
+    u32 nr_events;  /* RAS_EVENT_NR */
+    u32 event_size; /* sizeof(struct ras_event) */
+    u32 cpu;
+};
+
+int ras_events_enabled __read_mostly;
+static atomic_t ras_events_users = ATOMIC_INIT(0);
+
+static DEFINE_PER_CPU(struct ras_event_header *, ras_event_buffer);
+
+/*
+ * Record one event of p into this cpu's buffer.
+ */
+void __ras_event(int type, struct task_struct *p, int arg)
+{
+    struct ras_event_header *hdr;
+    struct ras_event *e;
+    unsigned long flags;
+    u32 head;
+
+    local_irq_save(flags);
+
+    hdr = __this_cpu_read(ras_event_buffer);
+    if (!hdr)
+        goto out;
+
+    head = hdr->head;
+    e = (struct ras_event *)((char *)hdr + RAS_EVENT_HDR_SIZE) + head % RAS_EVENT_NR;
+    e->time = local_clock();
+    e->pid = p->pid;
+    e->type = type;
+    e->arg = min_t(int, arg, USHRT_MAX);
+
+    /* publish the event before the new head */
+    smp_wmb();
+    hdr->head = head + 1;
+
+out:
+    local_irq_restore(flags);
+}
+
+static int ras_events_open(struct inode *inode, struct file *file)
+{
+    file->private_data = PDE(inode)->data;
+
+    if (atomic_inc_return(&ras_events_users) == 1)
+        ras_events_enabled = 1;
+
+    return 0;
+}
+
+static int ras_events_release(struct inode *inode, struct file *file)
+{
+    if (atomic_dec_and_test(&ras_events_users))
+        ras_events_enabled = 0;
+
+    return 0;
+}
+
+static int ras_events_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int cpu = (long)file->private_data;
+    struct ras_event_header *hdr = per_cpu(ras_event_buffer, cpu);
+
+    /* the buffer is written by the kernel only */
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vma->vm_flags &= ~VM_MAYWRITE;
+
+    return remap_vmalloc_range(vma, hdr, vma->vm_pgoff);
+}
+
+static const struct file_operations ras_events_fops = {
+    .owner = THIS_MODULE,
+    .open = ras_events_open,
+    .release = ras_events_release,
+    .mmap = ras_events_mmap,
+};
+
+static int __init ras_events_init(void)
+{
+    struct proc_dir_entry *dir;
+    struct ras_event_header *hdr;
+    char name[16];
+    int cpu;
+
+    dir = proc_mkdir("ras_events", NULL);
+    if (!dir)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu)
+    {
+        hdr = vmalloc_user(RAS_EVENT_HDR_SIZE + RAS_EVENT_DATA_SIZE);
+        if (!hdr)
+            return -ENOMEM;
+
+        hdr->nr_events = RAS_EVENT_NR;
+        hdr->event_size = sizeof(struct ras_event);
+        hdr->cpu = cpu;
+        per_cpu(ras_event_buffer, cpu) = hdr;
+
+        snprintf(name, sizeof(name), "cpu%d", cpu);
+        proc_create_data(name, 0400, dir, &ras_events_fops, (void *)(long)cpu);
+    }
+
+    return 0;
+}
+late_initcall(ras_events_init);
@@ -0,0 +1,109 @@
+/*
+ * Race-Averse Scheduling (RAS) preemption target index
+ *
+ * When every cpu is busy, a waking RAS task should preempt the cpu running
+ * the most write-heavy RAS task, if that one has a lower weight. Like
+ * cpupri does for RT priorities, every root domain keeps a cpumask per
+ * weight bucket of the current RAS task, so finding that cpu takes
+ * O(RASPRI_NR_BUCKETS) instead of a scan of every run queue.
+ *
+ * The count of a bucket is read before its mask without locks, so a
+ * result may be stale by the time it is used, as with cpupri. The task is
+ * then only queued behind a task it did not preempt.
+ */
+
+#include <linux/gfp.h>
+#include "raspri.h"
+
+/*
+ * Find a cpu of allowed that runs a RAS task of a lower weight bucket than
+ * p, the lowest bucket first. Returns -1 if there is none.
+ */
+int raspri_find(struct raspri *cp, struct task_struct *p, const struct cpumask *allowed)
+{
+    int bucket = raspri_bucket(p->ras.weight);
+    int idx, cpu;
+
+    for (idx = 0; idx < bucket; idx++)
+    {
+        struct raspri_vec *vec = &cp->bucket_to_cpu[idx];
+
+        if (!atomic_read(&vec->count))
+            continue;
+
+        /* pairs with the barriers of raspri_set() */
+        smp_rmb();
+
+        cpu = cpumask_any_and(allowed, vec->mask);
+        if (cpu < nr_cpu_ids)
+            return cpu;
+    }
+
+    return -1;
+}
+
+/*
+ * Move cpu to bucket, RASPRI_INVALID removes it from the index. Called with
+ * the rq->lock of cpu held.
+ */
+void raspri_set(struct raspri *cp, int cpu, int bucket)
+{
+    int old = cp->cpu_to_bucket[cpu];
+
+    if (old == bucket)
+        return;
+
+    /* add to the new bucket first, so that cpu is never missing */
+    if (bucket != RASPRI_INVALID)
+    {
+        struct raspri_vec *vec = &cp->bucket_to_cpu[bucket];
+
+        cpumask_set_cpu(cpu, vec->mask);
+        smp_mb__before_atomic_inc();
+        atomic_inc(&vec->count);
+    }
+    if (old != RASPRI_INVALID)
+    {
+        struct raspri_vec *vec = &cp->bucket_to_cpu[old];
+
+        atomic_dec(&vec->count);
+        smp_mb__after_atomic_dec();
+        cpumask_clear_cpu(cpu, vec->mask);
+    }
+
+    cp->cpu_to_bucket[cpu] = bucket;
+}
+
+int raspri_init(struct raspri *cp)
+{
+    int i;
+
+    memset(cp, 0, sizeof(*cp));
+
+    for (i = 0; i < RASPRI_NR_BUCKETS; i++)
+    {
+        struct raspri_vec *vec = &cp->bucket_to_cpu[i];
+
+        atomic_set(&vec->count, 0);
+        if (!zalloc_cpumask_var(&vec->mask, GFP_KERNEL))
+            goto cleanup;
+    }
+
+    for_each_possible_cpu(i)
+        cp->cpu_to_bucket[i] = RASPRI_INVALID;
+
+    return 0;
+
+cleanup:
+    for (i--; i >= 0; i--)
+        free_cpumask_var(cp->bucket_to_cpu[i].mask);
+    return -ENOMEM;
+}
+
+void raspri_cleanup(struct raspri *cp)
+{
+    int i;
+
+    for (i = 0; i < RASPRI_NR_BUCKETS; i++)
+        free_cpumask_var(cp->bucket_to_cpu[i].mask);
+}
@@ -0,0 +1,51 @@
+#ifndef _LINUX_RASPRI_H
+#define _LINUX_RASPRI_H
+
+#include <linux/sched.h>
+
+/*
+ * Index of the cpus of a root domain by the weight bucket of their current
+ * RAS task, like cpupri for RT. Bucket 0 holds the lowest weights, so the
+ * most write-heavy tasks. Cpus not running a RAS task are not indexed.
+ */
+#define RASPRI_NR_BUCKETS   10
+#define RASPRI_INVALID      -1
+
+struct raspri_vec
+{
+    atomic_t count;
+    cpumask_var_t mask;
+};
+
+struct raspri
+{
+    struct raspri_vec bucket_to_cpu[RASPRI_NR_BUCKETS];
+    int cpu_to_bucket[NR_CPUS];
+};
+
+extern unsigned int sysctl_sched_ras_max_weight;
+
+/*
+ * Map a RAS weight to its bucket, by its fraction of the maximum weight.
+ * The sysctl handlers index every cpu again when the maximum changes.
+ */
+static inline int raspri_bucket(int weight)
+{
+    int max_weight = sysctl_sched_ras_max_weight;
+
+    if (weight <= 0)
+        return RASPRI_INVALID;
+    if (weight >= max_weight)
+        return RASPRI_NR_BUCKETS - 1;
+
+    return (weight - 1) * RASPRI_NR_BUCKETS / max_weight;
+}
+
+#ifdef CONFIG_SMP
+int raspri_find(struct raspri *cp, struct task_struct *p, const struct cpumask *allowed);
+void raspri_set(struct raspri *cp, int cpu, int bucket);
+int raspri_init(struct raspri *cp);
+void raspri_cleanup(struct raspri *cp);
+#endif
+
+#endif /* _LINUX_RASPRI_H */
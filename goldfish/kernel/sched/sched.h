@@ -5,6 +5,7 @@
 #include <linux/stop_machine.h>
 
 #include "cpupri.h"
+#include "raspri.h"
 
 extern __read_mostly int scheduler_running;
 
@@ -134,6 +135,9 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+	/* cpu.ras_enable: the tasks of the group run traced as SCHED_RAS */
+	int ras_enable;
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -321,6 +325,7 @@ struct ras_rq {
 	struct list_head run_list;
 	unsigned long ras_nr_running;
 	int total_wcounts;	/* the total wcounts of every task in this ras_rq */
+	unsigned long total_weight;	/* the total weight of every task in this ras_rq */
 
 #ifdef CONFIG_SMP
 	unsigned long ras_nr_migratory;
@@ -366,6 +371,15 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The online cpus running their idle task, so with no RAS or CFS
+	 * work, for the RAS wakeup placement.
+	 */
+	cpumask_var_t ras_idle;
+
+	/* the cpus by the weight bucket of their current RAS task */
+	struct raspri raspri;
 };
 
 extern struct root_domain def_root_domain;
@@ -890,12 +904,41 @@ extern const struct sched_class idle_sched_class;
 extern void trigger_load_balance(struct rq *rq, int cpu);
 extern void idle_balance(int this_cpu, struct rq *this_rq);
 
+/*
+ * Track the idle cpus of the root domain on idle entry and exit, and the
+ * weight bucket of the current RAS task, called by __schedule() with
+ * rq->lock held. Offline cpus are left out, they are removed by
+ * rq_offline_ras().
+ */
+static inline void update_ras_cpu(struct rq *rq, struct task_struct *prev,
+				  struct task_struct *next)
+{
+	if (next == rq->idle) {
+		if (rq->online)
+			cpumask_set_cpu(rq->cpu, rq->rd->ras_idle);
+	} else if (prev == rq->idle) {
+		cpumask_clear_cpu(rq->cpu, rq->rd->ras_idle);
+	}
+
+	if (!rq->online)
+		return;
+	if (next->sched_class == &ras_sched_class)
+		raspri_set(&rq->rd->raspri, rq->cpu, raspri_bucket(next->ras.weight));
+	else if (prev->sched_class == &ras_sched_class)
+		raspri_set(&rq->rd->raspri, rq->cpu, RASPRI_INVALID);
+}
+
 #else	/* CONFIG_SMP */
 
 static inline void idle_balance(int cpu, struct rq *rq)
 {
 }
 
+static inline void update_ras_cpu(struct rq *rq, struct task_struct *prev,
+				  struct task_struct *next)
+{
+}
+
 #endif
 
 extern void sysrq_sched_debug_show(void);
@@ -1181,6 +1224,7 @@ extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
 extern void init_ras_rq(struct ras_rq *ras_rq, struct rq *rq);
 extern void unthrottle_offline_cfs_rqs(struct rq *rq);
+extern void drain_offline_ras_rq(struct rq *rq);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
 
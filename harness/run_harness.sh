@@ -0,0 +1,322 @@
+#!/bin/bash
+#
+# Operating System Project 2: run_harness.sh
+#
+# Build the RAS kernel, the system call modules and the benchmarks, boot
+# them in QEMU with a minimal initramfs and collect the results on the host.
+# The guest is ARM (vexpress-a9) or x86_64 (ARCH=x86_64).
+#
+# usage: run_harness.sh [-k kernel_dir] [-o out_dir] [-b baseline.tsv]
+#
+#     -k  full Linux 3.4 goldfish tree (default $KERNEL_DIR), left as it
+#         is: it is copied to out_dir/src and goldfish/ goes over the copy
+#     -o  output directory (default ./harness_out)
+#     -b  results.tsv of an earlier run, a metric worse by more than
+#         THRESHOLD percent is reported and the exit status is 1
+#
+# Environment:
+#     ARCH            arm or x86_64 (default arm)
+#     CROSS_COMPILE   target toolchain prefix (default arm-linux-gnueabi-
+#                     for arm, none for x86_64)
+#     DEFCONFIG       kernel config (default vexpress_defconfig for arm,
+#                     x86_64_defconfig for x86_64)
+#     QEMU_MACHINE    qemu-system-arm machine (default vexpress-a9)
+#     CPUS            number of cpus of the guest (default 4)
+#     BUSYBOX         statically linked busybox for the target (required)
+#     PRESET          RAS preset of the run (default: kernel default)
+#     CAPACITY        comma separated capacity of every cpu, e.g. 1024,1024,512,512
+#                     to run the guest as big.LITTLE (default: symmetric)
+#     ROUNDS          round trips of ctx_switch (default 20000)
+#     THRESHOLD       regression threshold in percent (default 10)
+#     TIMEOUT         seconds before the guest is killed (default 1800)
+#
+# Results:
+#     out_dir/src           the copy of the kernel tree with goldfish/ over it
+#     out_dir/console.log   the whole console of the guest
+#     out_dir/runs/<run>    the output of every benchmark run
+#     out_dir/results.tsv   run, metric and value of every result
+#
+
+set -e
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+KERNEL_DIR=${KERNEL_DIR:-}
+OUT=$PWD/harness_out
+BASELINE=
+
+ARCH=${ARCH:-arm}
+QEMU_MACHINE=${QEMU_MACHINE:-vexpress-a9}
+CPUS=${CPUS:-4}
+ROUNDS=${ROUNDS:-20000}
+THRESHOLD=${THRESHOLD:-10}
+TIMEOUT=${TIMEOUT:-1800}
+
+while getopts "k:o:b:" opt
+do
+	case $opt in
+	k) KERNEL_DIR=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	b) BASELINE=$OPTARG ;;
+	*) grep "^# usage" "$0"; exit 2 ;;
+	esac
+done
+
+die()
+{
+	echo "run_harness: $*" >&2
+	exit 2
+}
+
+# the kernel image and the qemu of every target
+case $ARCH in
+arm)
+	CROSS_COMPILE=${CROSS_COMPILE:-arm-linux-gnueabi-}
+	DEFCONFIG=${DEFCONFIG:-vexpress_defconfig}
+	IMAGE=arch/arm/boot/zImage
+	QEMU="qemu-system-arm -M $QEMU_MACHINE"
+	CONSOLE=ttyAMA0
+	;;
+x86_64)
+	CROSS_COMPILE=${CROSS_COMPILE-}
+	DEFCONFIG=${DEFCONFIG:-x86_64_defconfig}
+	IMAGE=arch/x86/boot/bzImage
+	QEMU=qemu-system-x86_64
+	CONSOLE=ttyS0
+	;;
+*)
+	die "ARCH must be arm or x86_64"
+	;;
+esac
+
+[ -d "$KERNEL_DIR/kernel/sched" ] || die "no kernel tree, use -k or KERNEL_DIR"
+[ -x "$BUSYBOX" ] || die "no static busybox for the target, set BUSYBOX"
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+SRC=$OUT/src
+KBUILD=$OUT/kernel
+JOBS=$(nproc)
+
+kmake()
+{
+	make -C "$SRC" O="$KBUILD" ARCH=$ARCH CROSS_COMPILE=$CROSS_COMPILE -j$JOBS "$@"
+}
+
+# kernel: the modified files of goldfish/ over a fresh copy of the full
+# tree, the tree of -k is never written. The copy keeps the timestamps, so
+# the objects in KBUILD of an earlier run are reused.
+echo "== kernel"
+rm -rf "$SRC"
+mkdir -p "$SRC" "$KBUILD"
+(cd "$KERNEL_DIR" && tar -cf - --exclude=.git .) | (cd "$SRC" && tar -xf -)
+cp -r "$REPO/goldfish/." "$SRC/"
+# changes to files goldfish/ does not carry whole, e.g. the x86 fault hooks
+for p in "$REPO"/patches/*.patch
+do
+	patch -d "$SRC" -p1 --forward -s < "$p" || die "$(basename "$p") does not apply"
+done
+kmake $DEFCONFIG
+"$SRC/scripts/config" --file "$KBUILD/.config" \
+	-e MODULES -e MODULE_UNLOAD -e SMP -e PERF_EVENTS -e PROC_FS -e SYSCTL -e KALLSYMS \
+	-e BLK_DEV_INITRD -e RD_GZIP -e DEVTMPFS -e CGROUPS -e CGROUP_SCHED -e HOTPLUG_CPU \
+	-d MODVERSIONS
+yes "" | kmake oldconfig > /dev/null
+kmake $(basename $IMAGE) modules
+
+# system call modules, patched with the system call table of this kernel
+echo "== modules"
+SYSCALL_TABLE=$(awk '$3 == "sys_call_table" { print $1 }' "$KBUILD/System.map")
+[ -n "$SYSCALL_TABLE" ] || die "sys_call_table not in System.map"
+rm -rf "$OUT/modules" "$OUT/rootfs"
+mkdir -p "$OUT/modules" "$OUT/rootfs/modules" "$OUT/rootfs/bench" "$OUT/rootfs/bin"
+for dir in "$REPO"/system_call/*/
+do
+	name=$(basename "$dir")
+	mkdir -p "$OUT/modules/$name"
+	sed "s/0xc000d8c4/0x$SYSCALL_TABLE/" "$dir/$name.c" > "$OUT/modules/$name/$name.c"
+	echo "obj-m := $name.o" > "$OUT/modules/$name/Kbuild"
+	kmake M="$OUT/modules/$name" modules
+	cp "$OUT/modules/$name/$name.ko" "$OUT/rootfs/modules/"
+done
+
+# the run queue self-test, loaded on its own by init
+mkdir -p "$OUT/modules/ras_selftest" "$OUT/rootfs/selftest"
+cp "$REPO/test/ras_selftest/ras_selftest.c" "$OUT/modules/ras_selftest/"
+echo "obj-m := ras_selftest.o" > "$OUT/modules/ras_selftest/Kbuild"
+kmake M="$OUT/modules/ras_selftest" modules
+cp "$OUT/modules/ras_selftest/ras_selftest.ko" "$OUT/rootfs/selftest/"
+
+# benchmarks, linked statically so the initramfs needs no libc
+echo "== benchmarks"
+# a benchmark that does not build is reported and left out, its runs then
+# end with exit status 127 instead of stopping the whole harness
+BROKEN=
+for src in "$REPO"/test/*/jni/*.c
+do
+	name=$(basename "$src" .c)
+	if ! ${CROSS_COMPILE}gcc -O2 -static -pthread -o "$OUT/rootfs/bench/$name" "$src" -lm
+	then
+		echo "== benchmark $name failed to build" >&2
+		BROKEN="$BROKEN $name"
+	fi
+done
+
+# initramfs
+echo "== initramfs"
+cp "$BUSYBOX" "$OUT/rootfs/bin/busybox"
+cp "$REPO/harness/init" "$OUT/rootfs/init"
+mkdir -p "$OUT/rootfs/proc" "$OUT/rootfs/sys" "$OUT/rootfs/dev" "$OUT/rootfs/tmp"
+(cd "$OUT/rootfs" && find . | cpio -o -H newc --quiet | gzip -9) > "$OUT/initramfs.gz"
+
+# boot
+echo "== boot"
+APPEND="console=$CONSOLE rdinit=/init harness.rounds=$ROUNDS"
+[ -n "$PRESET" ] && APPEND="$APPEND harness.preset=$PRESET"
+[ -n "$CAPACITY" ] && APPEND="$APPEND harness.capacity=$CAPACITY"
+timeout $TIMEOUT $QEMU -smp $CPUS -m 512 -nographic -no-reboot \
+	-kernel "$KBUILD/$IMAGE" -initrd "$OUT/initramfs.gz" \
+	-append "$APPEND" < /dev/null | tr -d '\r' | tee "$OUT/console.log" ||
+	echo "run_harness: qemu failed or timed out" >&2
+grep -q "^@@ DONE" "$OUT/console.log" || die "the guest did not finish the benchmarks"
+
+# results: split the console into runs and extract the metrics
+echo "== results"
+rm -rf "$OUT/runs"
+mkdir -p "$OUT/runs"
+awk -v dir="$OUT/runs" '
+/^@@ BEGIN / { run = $3; file = dir "/" run; next }
+/^@@ END /   { printf "%s\texit_status\t%s\n", run, $4; run = ""; next }
+run == ""    { next }
+{ print > file }
+
+# race_workload: SCHED_RAS-LOCK: conflicts: 12, conflict rate: 1.20%, lock wait: 30us, makespan: 800ms
+/conflict rate:/ {
+	split($1, sched, ":")
+	line = $0
+	gsub(/[%,]|us|ms/, "", line)
+	n = split(line, f, " ")
+	for (i = 1; i < n; i++)
+	{
+		if (f[i] == "conflicts:") printf "%s/%s\tconflicts\t%s\n", run, sched[1], f[i + 1]
+		if (f[i] == "rate:")      printf "%s/%s\tconflict_rate\t%s\n", run, sched[1], f[i + 1]
+		if (f[i] == "wait:")      printf "%s/%s\tlock_wait_us\t%s\n", run, sched[1], f[i + 1]
+		if (f[i] == "makespan:")  printf "%s/%s\tmakespan_ms\t%s\n", run, sched[1], f[i + 1]
+	}
+}
+
+# ctx_switch: pair 0: 20000 round trips, 5000ns per round trip, 2500ns per switch,
+# 2300ns per switch without faults, 200ns added by faults, 8000ns per fault
+/ns per switch,/ {
+	line = $0
+	sub(/ns per switch,.*/, "", line)
+	n = split(line, f, " ")
+	switch_ns[run] += f[n]
+	line = $0
+	sub(/ns per switch without.*/, "", line)
+	n = split(line, f, " ")
+	switch_base_ns[run] += f[n]
+	pairs[run]++
+}
+
+# exec_time: SCHED_RAS-PROCESS_NUM: 10, then one "pid: N, Xms" line per process
+/-PROCESS_NUM:/ {
+	name = $1
+	sub(/:$/, "", name)
+	group = run "/" name "=" $2
+}
+/^pid: [0-9]+, [0-9]+ms$/ {
+	ms = $3
+	sub(/ms/, "", ms)
+	exec_ms[group] += ms
+	exec_nr[group]++
+}
+
+# ras_selftest: ras_selftest:: threads: 16, duration: 10s, checks: 4000, 900ns per check, broken invariants: 0
+/^ras_selftest:: threads:/ { printf "%s\tbroken_invariants\t%d\n", run, $NF }
+/^ras_selftest:: [a-z_]+: [0-9]+ ops, [0-9]+ns per op$/ {
+	ns = $5
+	sub(/ns/, "", ns)
+	op = $2
+	sub(/:/, "", op)
+	printf "%s\t%s_ns\t%d\n", run, op, ns
+}
+
+# yield_spin: yield_spin: yield_to: threads: 16, spins per acquire: 40, yields: 900, makespan: 800ms, OK
+/^yield_spin: / {
+	mode = $2
+	sub(/:/, "", mode)
+	spins = $8
+	sub(/,/, "", spins)
+	ms = $(NF - 1)
+	sub(/ms,/, "", ms)
+	printf "%s/%s\tspins_per_acquire\t%d\n", run, mode, spins
+	printf "%s/%s\tmakespan_ms\t%d\n", run, mode, ms
+}
+
+# yield_spin: yield_to vs yield: spins per acquire: 40 vs 90, makespan: 800ms vs 900ms, SHORTER
+/^yield_to vs yield: / { printf "%s\tyield_to_shorter\t%d\n", run, $NF == "SHORTER" }
+
+# futex_contention: futex_contention: contention: 4, threads: 8, makespan: 900ms, colocated: 60%, OK
+/^futex_contention: contention: / {
+	contention = $3
+	sub(/,/, "", contention)
+	ms = $7
+	sub(/ms,/, "", ms)
+	printf "%s/%s\tmakespan_ms\t%d\n", run, contention, ms
+}
+
+# futex_contention: colocated: 40% -> 60%, pipe wakeups counted: 0, OK
+/^futex_contention: colocated: / { printf "%s\tcontention_ok\t%d\n", run, $NF == "OK" }
+
+# affinity_mix: hotplug: cpu 3, rounds on it while offline: 0, OK
+/^hotplug: cpu [0-9]+, rounds/ { printf "%s\thotplug_ok\t%d\n", run, $NF == "OK" }
+
+# cgroup_ras: cgroup_ras: attached: 6, forked: 6, left: 0, disabled: 0, OK
+/^cgroup_ras: / { printf "%s\tcgroup_ras_ok\t%d\n", run, $NF == "OK" }
+
+# mem_test: samples = 1 in 120us + 1 in 80us, OK
+/^samples = .*(OK|FAIL)$/ { printf "%s\tsamples_ok\t%d\n", run, $NF == "OK" }
+
+# thread_trace correctness
+/group Wcount = .*(OK|FAIL)$/ { printf "%s\tgroup_wcounts_ok\t%d\n", run, $NF == "OK" }
+
+END {
+	for (r in pairs)
+	{
+		printf "%s\tns_per_switch\t%d\n", r, switch_ns[r] / pairs[r]
+		printf "%s\tns_per_switch_nofault\t%d\n", r, switch_base_ns[r] / pairs[r]
+	}
+	for (g in exec_nr)
+		printf "%s\tavg_ms\t%d\n", g, exec_ms[g] / exec_nr[g]
+}
+' "$OUT/console.log" | sort > "$OUT/results.tsv"
+cat "$OUT/results.tsv"
+[ -z "$BROKEN" ] || echo "== benchmarks that did not build:$BROKEN"
+
+# regressions against the baseline: a larger value is worse for every
+# metric except the correctness checks, which must not change
+[ -n "$BASELINE" ] || exit 0
+echo "== compare with $BASELINE"
+awk -F '\t' -v threshold=$THRESHOLD '
+NR == FNR { base[$1 "\t" $2] = $3; next }
+{
+	key = $1 "\t" $2
+	if (!(key in base))
+		next
+	if ($2 == "exit_status" || $2 == "group_wcounts_ok" || $2 == "broken_invariants" || $2 == "cgroup_ras_ok" || $2 == "samples_ok" || $2 == "yield_to_shorter" || $2 == "contention_ok" || \
+	    $2 == "hotplug_ok")
+	{
+		if ($3 != base[key])
+		{
+			printf "REGRESSION %s: %s -> %s\n", key, base[key], $3
+			bad = 1
+		}
+	}
+	else if (base[key] > 0 && ($3 - base[key]) * 100 > base[key] * threshold)
+	{
+		printf "REGRESSION %s: %s -> %s (+%.1f%%)\n", key, base[key], $3,
+			($3 - base[key]) * 100 / base[key]
+		bad = 1
+	}
+}
+END { exit bad }
+' "$BASELINE" "$OUT/results.tsv" && echo "no regression"
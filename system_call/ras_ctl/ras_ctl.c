@@ -0,0 +1,529 @@
+/*
+Operating System Project 2: ras_ctl.c
+
+The implementation of system call ras_ctl, the RAS operations beyond
+start_trace, stop_trace and get_trace behind one system call number:
+
+    long ras_ctl(int op, ...);
+
+op                              arguments
+RAS_CTL_START_TRACE_GROUP (0)   pid_t tgid
+    Start tracing page writes for every thread in the thread group of tgid.
+    Threads created afterwards inherit the tracing, and RAS weights every
+    thread by the total of the group. Changing the weights needs the
+    permission of sched_setaffinity() on tgid: the same owner or
+    CAP_SYS_NICE.
+RAS_CTL_STOP_TRACE_GROUP (1)    pid_t tgid
+    Stop tracing page writes for every thread in the thread group of tgid,
+    with the same permission.
+RAS_CTL_GET_TRACE_GROUP (2)     pid_t tgid, int *wcounts, int *nr_threads
+    Return the total wcounts of the thread group of tgid since
+    RAS_CTL_START_TRACE_GROUP, and the number of threads in the group.
+    Like every operation reading the writes of another task, it needs the
+    permission to read the /proc files of tgid.
+RAS_CTL_NOTIFY (3)              pid_t pid, int efd, int wthreshold,
+                                int rate_threshold, int flags
+    Register an eventfd that is signaled when the traced process pid writes
+    its wthreshold-th page, when its page writes per second reach
+    rate_threshold, or, with flags RAS_NOTIFY_WEIGHT(1), when its RAS weight
+    changes. Every condition is edge triggered. A negative efd drops the
+    registration. Both need the permission to read the /proc files of pid.
+RAS_CTL_SET_ATTR (4)            pid_t pid, struct sched_ras_attr *attr
+    Set the RAS attributes of pid (0 is the caller): a static priority
+    added to its weight (-5..5), a latency sensitivity shortening its time
+    slice and queueing it first after a wakeup (0..3), and the percentage
+    of its page writes counted for the weight (0..1000, 0 opts out).
+RAS_CTL_GET_ATTR (5)            pid_t pid, struct sched_ras_attr *attr
+    Return the RAS attributes of pid (0 is the caller).
+RAS_CTL_GET_TRACE_TYPES (6)     pid_t pid, int *counts, int nr
+    Return the page writes of pid broken down by the kind of write (enum
+    ras_write_type): writes to non-writable memory, copy-on-write breaks,
+    first writes to anonymous pages and dirtying of shared file pages. The
+    sum of the kinds is the wcounts returned by get_trace. The number of
+    entries filled is returned.
+RAS_CTL_YIELD_TO (7)            pid_t pid
+    Donate the rest of the caller's time slice to the thread pid, which
+    runs next on its cpu, e.g. a waiter spinning on a user-level lock
+    yields to the lock holder. Both must be in the same scheduling class,
+    SCHED_RAS or SCHED_NORMAL, and the caller needs the permission of
+    sched_setaffinity() on pid. Returns 1 if the caller yielded, 0 if pid is
+    running or not runnable.
+RAS_CTL_GET_CONTENTION (8)      pid_t pid, struct ras_contender *c, int nr
+    Return the SCHED_RAS tasks that woke pid by releasing a futex it was
+    blocked on, how often (halved every second), how long it was
+    blocked in total and the wcounts of every waker (-1 if it exited), as
+    struct ras_contender { int pid; unsigned int count; unsigned long long
+    wait_ns; int wcounts; }. At most RAS_NR_CONTENDERS (4) are kept. The
+    number of entries filled is returned.
+RAS_CTL_CS_REGISTER (9)         struct ras_cs *cs
+    Register the critical section flag of the calling thread, a struct
+    ras_cs { unsigned int in_cs; unsigned int yield_pending; } in its
+    memory, or unregister it if cs is NULL. While in_cs is set, a SCHED_RAS
+    slice that runs out is extended once by min_granularity, and the
+    scheduler sets yield_pending; the thread then clears it and calls
+    sched_yield() when it leaves the critical section. A forked child and
+    a new program image start unregistered.
+RAS_CTL_SAMPLE_TRACE (10)       pid_t *pids, int nr, struct ras_trace_sample *s
+    Sample the page writes of nr processes at once: for every pid of pids
+    fill one struct ras_trace_sample with the writes since start_trace, by
+    kind, when start_trace counted from and the time of the sample, in ns.
+    Nothing is reset, the writes of an interval are the difference of two
+    samples with the same start_ns, so samplers do not disturb each other.
+    Returns the number of pids sampled. The samples of the others have
+    traced set to -ESRCH, or -EPERM without the permission to read the
+    /proc files of the pid.
+
+The system call number is 378 on ARM and 184 on x86_64. The numbers up to
+377 are all in use in the ARM EABI table, and 378 and 379 are the padding
+entries before NR_syscalls (380); a number from NR_syscalls on never
+reaches the table. 184 is tuxcall, which x86_64 never implemented. The
+module refuses to load if the entry is not sys_ni_syscall and puts it back
+when it is removed.
+*/
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/unistd.h>
+#include <linux/uaccess.h>
+#include <linux/eventfd.h>
+#include <linux/err.h>
+#include <linux/kallsyms.h>
+
+MODULE_LICENSE("Dual BSD/GPL");
+
+/* a free entry of the table, see the comment above */
+#if defined(CONFIG_ARM)
+#define __NR_sys_ras_ctl 378
+#elif defined(CONFIG_X86_64)
+#define __NR_sys_ras_ctl 184
+#else
+#error "ras_ctl: no free system call number for this architecture"
+#endif
+
+enum
+{
+    RAS_CTL_START_TRACE_GROUP,
+    RAS_CTL_STOP_TRACE_GROUP,
+    RAS_CTL_GET_TRACE_GROUP,
+    RAS_CTL_NOTIFY,
+    RAS_CTL_SET_ATTR,
+    RAS_CTL_GET_ATTR,
+    RAS_CTL_GET_TRACE_TYPES,
+    RAS_CTL_YIELD_TO,
+    RAS_CTL_GET_CONTENTION,
+    RAS_CTL_CS_REGISTER,
+    RAS_CTL_SAMPLE_TRACE,
+};
+
+/* pids sampled per copy from and to the user */
+#define SAMPLE_BATCH 16
+
+static long *sys_call_table;
+static int (*oldcall)(void);
+
+/* the x86 table is read-only, lift the write protection for the store */
+static void set_syscall(unsigned long call)
+{
+#ifdef CONFIG_X86
+    unsigned long cr0;
+
+    preempt_disable();
+    cr0 = read_cr0();
+    write_cr0(cr0 & ~X86_CR0_WP);
+    sys_call_table[__NR_sys_ras_ctl] = call;
+    write_cr0(cr0);
+    preempt_enable();
+#else
+    sys_call_table[__NR_sys_ras_ctl] = call;
+#endif
+}
+
+static long start_trace_group(pid_t tgid)
+{
+    struct task_struct *tsk, *t;
+    int started = 0;
+    long ret = 0;
+
+    /* keep the key on while the threads are switched, see ras_trace_start() */
+    ras_trace_get();
+    rcu_read_lock();
+
+    /* get the task_struct according to tgid */
+    tsk = pid_task(find_vpid(tgid), PIDTYPE_PID);
+    if (!tsk)
+    {
+        ret = -ESRCH;
+        goto out;
+    }
+    if (!sched_may_change_ras(tsk))
+    {
+        ret = -EPERM;
+        goto out;
+    }
+
+    /* return -EINVAL if called twice without RAS_CTL_STOP_TRACE_GROUP being called in between */
+    if (tsk->signal->trace_group)
+    {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* initialize the group wcounts, then set the trace_flag of every thread */
+    atomic_set(&tsk->signal->wcounts, 0);
+    for_each_thread(tsk, t)
+    {
+        ras_reset_wcounts(t);
+        if (ras_trace_set(t, true))
+            started++;
+    }
+    tsk->signal->trace_group = true;
+
+out:
+    rcu_read_unlock();
+
+    /* one reference per newly traced thread */
+    while (started--)
+        ras_trace_get();
+    ras_trace_put();
+
+    return ret;
+}
+
+static long stop_trace_group(pid_t tgid)
+{
+    struct task_struct *tsk, *t;
+    int stopped = 0;
+
+    rcu_read_lock();
+
+    /* get the task_struct according to tgid */
+    tsk = pid_task(find_vpid(tgid), PIDTYPE_PID);
+    if (!tsk || !sched_may_change_ras(tsk))
+    {
+        rcu_read_unlock();
+        return tsk ? -EPERM : -ESRCH;
+    }
+
+    /* clear the trace_flag of every thread, the group wcounts is kept for RAS_CTL_GET_TRACE_GROUP */
+    tsk->signal->trace_group = false;
+    for_each_thread(tsk, t)
+    {
+        if (ras_trace_set(t, false))
+            stopped++;
+    }
+
+    rcu_read_unlock();
+
+    /* drop the references of the threads that were traced */
+    while (stopped--)
+        ras_trace_put();
+
+    return 0;
+}
+
+static long get_trace_group(pid_t tgid, int __user *wcounts, int __user *nr_threads)
+{
+    struct task_struct *tsk;
+    int total, threads;
+
+    rcu_read_lock();
+
+    /* get the task_struct according to tgid */
+    tsk = pid_task(find_vpid(tgid), PIDTYPE_PID);
+    if (!tsk || !ras_may_read(tsk))
+    {
+        rcu_read_unlock();
+        return tsk ? -EPERM : -ESRCH;
+    }
+
+    /* the group wcounts also keeps the writes of threads that already exited */
+    total = atomic_read(&tsk->signal->wcounts);
+    threads = get_nr_threads(tsk);
+
+    rcu_read_unlock();
+
+    /* return the wcounts */
+    if (put_user(total, wcounts))
+        return -EFAULT;
+    if (nr_threads && put_user(threads, nr_threads))
+        return -EFAULT;
+
+    return 0;
+}
+
+static long ras_notify(pid_t pid, int efd, int wthreshold, int rate_threshold, int flags)
+{
+    struct task_struct *tsk;
+    struct eventfd_ctx *ctx;
+    long ret = 0;
+
+    if (wthreshold < 0 || rate_threshold < 0 || (flags & ~RAS_NOTIFY_WEIGHT))
+        return -EINVAL;
+
+    /* get the task_struct according to pid */
+    rcu_read_lock();
+    tsk = pid_task(find_vpid(pid), PIDTYPE_PID);
+    if (tsk)
+        get_task_struct(tsk);
+    rcu_read_unlock();
+    if (!tsk)
+        return -ESRCH;
+
+    if (efd < 0)
+    {
+        ret = ras_notify_unregister(tsk);
+        goto out;
+    }
+
+    ctx = eventfd_ctx_fdget(efd);
+    if (IS_ERR(ctx))
+    {
+        ret = PTR_ERR(ctx);
+        goto out;
+    }
+
+    /* the task keeps the reference on ctx until it is unregistered or dies */
+    ret = ras_notify_register(tsk, ctx, wthreshold, rate_threshold, flags);
+    if (ret)
+        eventfd_ctx_put(ctx);
+
+out:
+    put_task_struct(tsk);
+    return ret;
+}
+
+static long set_ras_attr(pid_t pid, struct sched_ras_attr __user *uattr)
+{
+    struct sched_ras_attr attr;
+    struct task_struct *tsk;
+    long ret;
+
+    if (copy_from_user(&attr, uattr, sizeof(attr)))
+        return -EFAULT;
+
+    /* get the task_struct according to pid, 0 means the caller */
+    rcu_read_lock();
+    tsk = pid ? pid_task(find_vpid(pid), PIDTYPE_PID) : current;
+    if (tsk)
+        get_task_struct(tsk);
+    rcu_read_unlock();
+    if (!tsk)
+        return -ESRCH;
+
+    ret = sched_setattr_ras(tsk, &attr);
+
+    put_task_struct(tsk);
+    return ret;
+}
+
+static long get_ras_attr(pid_t pid, struct sched_ras_attr __user *uattr)
+{
+    struct sched_ras_attr attr;
+    struct task_struct *tsk;
+
+    /* get the task_struct according to pid, 0 means the caller */
+    rcu_read_lock();
+    tsk = pid ? pid_task(find_vpid(pid), PIDTYPE_PID) : current;
+    if (!tsk)
+    {
+        rcu_read_unlock();
+        return -ESRCH;
+    }
+    sched_getattr_ras(tsk, &attr);
+    rcu_read_unlock();
+
+    /* return the attributes */
+    if (copy_to_user(uattr, &attr, sizeof(attr)))
+        return -EFAULT;
+
+    return 0;
+}
+
+static long get_trace_types(pid_t pid, int __user *counts, int nr)
+{
+    struct task_struct *tsk;
+    int types[RAS_NR_WRITE_TYPES];
+
+    if (nr < 0)
+        return -EINVAL;
+    nr = min(nr, RAS_NR_WRITE_TYPES);
+
+    rcu_read_lock();
+
+    /* get the task_struct according to pid */
+    tsk = pid_task(find_vpid(pid), PIDTYPE_PID);
+    if (!tsk || !ras_may_read(tsk))
+    {
+        rcu_read_unlock();
+        return tsk ? -EPERM : -ESRCH;
+    }
+
+    memcpy(types, tsk->wcounts_type, sizeof(types));
+
+    rcu_read_unlock();
+
+    /* return the counts the caller has room for */
+    if (copy_to_user(counts, types, nr * sizeof(int)))
+        return -EFAULT;
+
+    return nr;
+}
+
+static long ras_yield_to(pid_t pid)
+{
+    struct task_struct *tsk;
+    bool yielded;
+
+    /* get the task_struct according to pid */
+    rcu_read_lock();
+    tsk = pid_task(find_vpid(pid), PIDTYPE_PID);
+    if (tsk)
+        get_task_struct(tsk);
+    rcu_read_unlock();
+    if (!tsk)
+        return -ESRCH;
+
+    /* pid runs next on its cpu, so like moving it, see sched_setaffinity() */
+    if (!sched_may_change_ras(tsk))
+    {
+        put_task_struct(tsk);
+        return -EPERM;
+    }
+
+    yielded = tsk != current && yield_to(tsk, true);
+
+    put_task_struct(tsk);
+    return yielded;
+}
+
+static long get_trace_contention(pid_t pid, struct ras_contender __user *contenders, int nr)
+{
+    struct ras_contender c[RAS_NR_CONTENDERS];
+    struct task_struct *tsk;
+
+    if (nr < 0)
+        return -EINVAL;
+
+    rcu_read_lock();
+
+    /* get the task_struct according to pid */
+    tsk = pid_task(find_vpid(pid), PIDTYPE_PID);
+    if (!tsk || !ras_may_read(tsk))
+    {
+        rcu_read_unlock();
+        return tsk ? -EPERM : -ESRCH;
+    }
+
+    nr = ras_get_contenders(tsk, c, nr);
+
+    rcu_read_unlock();
+
+    if (copy_to_user(contenders, c, nr * sizeof(*c)))
+        return -EFAULT;
+
+    return nr;
+}
+
+static long sample_trace(const pid_t __user *pids, int nr, struct ras_trace_sample __user *samples)
+{
+    struct ras_trace_sample s[SAMPLE_BATCH];
+    pid_t pid[SAMPLE_BATCH];
+    struct task_struct *tsk;
+    int i, n, err, done, found = 0;
+
+    if (nr < 0)
+        return -EINVAL;
+
+    for (done = 0; done < nr; done += n)
+    {
+        n = min(nr - done, SAMPLE_BATCH);
+        if (copy_from_user(pid, pids + done, n * sizeof(pid_t)))
+            return -EFAULT;
+
+        rcu_read_lock();
+        for (i = 0; i < n; i++)
+        {
+            /* get the task_struct according to pid */
+            tsk = pid_task(find_vpid(pid[i]), PIDTYPE_PID);
+            err = tsk ? ras_trace_sample(tsk, &s[i]) : -ESRCH;
+            if (err)
+            {
+                memset(&s[i], 0, sizeof(s[i]));
+                s[i].pid = pid[i];
+                s[i].traced = err;
+                continue;
+            }
+            found++;
+        }
+        rcu_read_unlock();
+
+        if (copy_to_user(samples + done, s, n * sizeof(s[0])))
+            return -EFAULT;
+    }
+
+    return found;
+}
+
+long sys_ras_ctl(int op, unsigned long arg1, unsigned long arg2, unsigned long arg3,
+                 unsigned long arg4, unsigned long arg5)
+{
+    switch (op)
+    {
+    case RAS_CTL_START_TRACE_GROUP:
+        return start_trace_group((pid_t)arg1);
+    case RAS_CTL_STOP_TRACE_GROUP:
+        return stop_trace_group((pid_t)arg1);
+    case RAS_CTL_GET_TRACE_GROUP:
+        return get_trace_group((pid_t)arg1, (int __user *)arg2, (int __user *)arg3);
+    case RAS_CTL_NOTIFY:
+        return ras_notify((pid_t)arg1, (int)arg2, (int)arg3, (int)arg4, (int)arg5);
+    case RAS_CTL_SET_ATTR:
+        return set_ras_attr((pid_t)arg1, (struct sched_ras_attr __user *)arg2);
+    case RAS_CTL_GET_ATTR:
+        return get_ras_attr((pid_t)arg1, (struct sched_ras_attr __user *)arg2);
+    case RAS_CTL_GET_TRACE_TYPES:
+        return get_trace_types((pid_t)arg1, (int __user *)arg2, (int)arg3);
+    case RAS_CTL_YIELD_TO:
+        return ras_yield_to((pid_t)arg1);
+    case RAS_CTL_GET_CONTENTION:
+        return get_trace_contention((pid_t)arg1, (struct ras_contender __user *)arg2, (int)arg3);
+    case RAS_CTL_CS_REGISTER:
+        return ras_cs_register((struct ras_cs __user *)arg1);
+    case RAS_CTL_SAMPLE_TRACE:
+        return sample_trace((const pid_t __user *)arg1, (int)arg2,
+                            (struct ras_trace_sample __user *)arg3);
+    default:
+        return -EINVAL;
+    }
+}
+
+static int addsyscall_init(void)
+{
+    unsigned long ni_syscall = kallsyms_lookup_name("sys_ni_syscall");
+
+    /* the table is looked up instead of patched in, it moves with every build */
+    sys_call_table = (long *)kallsyms_lookup_name("sys_call_table");
+    if (!sys_call_table || !ni_syscall)
+        return -ENOENT;
+
+    /* never take an entry that is in use */
+    oldcall = (int (*)(void))(sys_call_table[__NR_sys_ras_ctl]);
+    if ((unsigned long)oldcall != ni_syscall)
+    {
+        printk(KERN_ERR "ras_ctl:: system call %d is in use\n", __NR_sys_ras_ctl);
+        return -EBUSY;
+    }
+    set_syscall((unsigned long)sys_ras_ctl);
+    printk(KERN_INFO "module load!\n");
+    return 0;
+}
+
+static void addsyscall_exit(void)
+{
+    set_syscall((unsigned long)oldcall);
+    printk(KERN_INFO "module exit!\n");
+}
+module_init(addsyscall_init);
+module_exit(addsyscall_exit);
@@ -3,7 +3,7 @@ Operating System Project 2: start_trace.c
 
 The implementation of system call strat_trace.
 It tells the kernel to start tracing page writes for the given process pid.
-The system call number is 361.
+The system call number is 361, 181 (getpmsg, never implemented) on x86_64.
 */
 
 #include <linux/module.h>
@@ -13,32 +13,58 @@ The system call number is 361.
 #include <linux/unistd.h>
 
 MODULE_LICENSE("Dual BSD/GPL");
+#ifdef CONFIG_X86_64
+#define __NR_sys_start_trace 181
+#else
 #define __NR_sys_start_trace 361
+#endif
 
 static int (*oldcall)(void);
 
+/* the x86 table is read-only, lift the write protection for the store */
+static void set_syscall(long *syscall, unsigned long call)
+{
+#ifdef CONFIG_X86
+    unsigned long cr0;
+
+    preempt_disable();
+    cr0 = read_cr0();
+    write_cr0(cr0 & ~X86_CR0_WP);
+    syscall[__NR_sys_start_trace] = call;
+    write_cr0(cr0);
+    preempt_enable();
+#else
+    syscall[__NR_sys_start_trace] = call;
+#endif
+}
+
 void *sys_start_trace(pid_t pid, unsigned long start, size_t size)
 {
     struct task_struct *tsk;
 
     /* get the task_struct according to pid */
+    rcu_read_lock();
     tsk = pid_task(find_vpid(pid), PIDTYPE_PID);
+    if (tsk)
+        get_task_struct(tsk);
+    rcu_read_unlock();
     if (!tsk)
     {
         return -1;
     }
 
-    /* return -EINVAL if called twice without sys_stop_trace being called in between */
-    if (tsk->trace_flag)
+    /* set the trace_flag, return -EINVAL if called twice without sys_stop_trace being called in between */
+    if (!ras_trace_start(tsk))
     {
+        put_task_struct(tsk);
         return -EINVAL;
     }
 
-    /* set the trace_flag and initialize wcounts */
-    tsk->trace_flag = true;
-    tsk->wcounts = 0;
+    /* initialize wcounts */
+    ras_reset_wcounts(tsk);
     printk("start_trace:: pid: %d\n", pid);
 
+    put_task_struct(tsk);
     return 0;
 }
 
@@ -46,7 +72,7 @@ static int addsyscall_init(void)
 {
     long *syscall = (long *)0xc000d8c4;
     oldcall = (int (*)(void))(syscall[__NR_sys_start_trace]);
-    syscall[__NR_sys_start_trace] = (unsigned long)sys_start_trace;
+    set_syscall(syscall, (unsigned long)sys_start_trace);
     printk(KERN_INFO "module load!\n");
     return 0;
 }
@@ -54,7 +80,7 @@ static int addsyscall_init(void)
 static void addsyscall_exit(void)
 {
     long *syscall = (long *)0xc000d8c4;
-    syscall[__NR_sys_start_trace] = (unsigned long)oldcall;
+    set_syscall(syscall, (unsigned long)oldcall);
     printk(KERN_INFO "module exit!\n");
 }
 module_init(addsyscall_init);
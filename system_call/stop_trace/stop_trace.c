@@ -3,7 +3,7 @@ Operating System Project 2: stop_trace.c
 
 The implementation of system call stop_trace.
 It tells the kernel to stop tracing page writes for the given process pid.
-The system call number is 362.
+The system call number is 362, 182 (putpmsg, never implemented) on x86_64.
 */
 
 #include <linux/module.h>
@@ -13,25 +13,50 @@ The system call number is 362.
 #include <linux/unistd.h>
 
 MODULE_LICENSE("Dual BSD/GPL");
+#ifdef CONFIG_X86_64
+#define __NR_sys_stop_trace 182
+#else
 #define __NR_sys_stop_trace 362
+#endif
 
 static int (*oldcall)(void);
 
+/* the x86 table is read-only, lift the write protection for the store */
+static void set_syscall(long *syscall, unsigned long call)
+{
+#ifdef CONFIG_X86
+    unsigned long cr0;
+
+    preempt_disable();
+    cr0 = read_cr0();
+    write_cr0(cr0 & ~X86_CR0_WP);
+    syscall[__NR_sys_stop_trace] = call;
+    write_cr0(cr0);
+    preempt_enable();
+#else
+    syscall[__NR_sys_stop_trace] = call;
+#endif
+}
 
 void* sys_stop_trace(pid_t pid)
 {
     struct task_struct *tsk;
 
     /* get the task_struct according to pid */
+    rcu_read_lock();
     tsk=pid_task(find_vpid(pid), PIDTYPE_PID);
+    if(tsk)
+        get_task_struct(tsk);
+    rcu_read_unlock();
     if(!tsk){
         return -1;
     }
 
-    /* set the trace_flag */
-    tsk->trace_flag=false;
+    /* clear the trace_flag */
+    ras_trace_stop(tsk);
     printk("stop_trace:: pid: %d\n", pid);
 
+    put_task_struct(tsk);
     return 0;
 }
 
@@ -39,7 +64,7 @@ static int addsyscall_init(void)
 {
     long *syscall = (long *)0xc000d8c4;
     oldcall = (int (*)(void))(syscall[__NR_sys_stop_trace]);
-    syscall[__NR_sys_stop_trace] = (unsigned long)sys_stop_trace;
+    set_syscall(syscall, (unsigned long)sys_stop_trace);
     printk(KERN_INFO "module load!\n");
     return 0;
 }
@@ -47,7 +72,7 @@ static int addsyscall_init(void)
 static void addsyscall_exit(void)
 {
     long *syscall = (long *)0xc000d8c4;
-    syscall[__NR_sys_stop_trace] = (unsigned long)oldcall;
+    set_syscall(syscall, (unsigned long)oldcall);
     printk(KERN_INFO "module exit!\n");
 }
 module_init(addsyscall_init);
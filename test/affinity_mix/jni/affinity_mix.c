@@ -0,0 +1,271 @@
+/*
+Operating System Project 2: affinity_mix.c
+
+Test the affinity handling of the RAS scheduler with pinned and free
+tasks under load. Every pinned worker is bound to one cpu and must never
+run anywhere else, the free workers may run on every cpu. All of them are
+traced RAS tasks that keep taking write faults and sleeping, so they are
+woken and placed again and again. Some pinned workers are freed and
+pinned again halfway, to exercise the affinity changes of queued tasks.
+
+With -u, the last cpu is taken offline once every worker has started and
+brought back online 100ms later, through /sys/devices/system/cpu, so the
+RAS tasks queued on it are drained to the other cpus. No worker is pinned
+to it then, and the test fails if a worker runs on it while it is offline.
+
+usage: affinity_mix [-p pinned] [-f free] [-r rounds] [-s policy] [-u]
+    -p  number of pinned workers (default 2 per cpu)
+    -f  number of free workers (default 2 per cpu)
+    -r  rounds of writes and sleeps of every worker (default 2000)
+    -s  scheduling policy (default 6, SCHED_RAS)
+    -u  unplug and replug the last cpu while the workers run
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#endif
+
+#define SCHED_RAS 6
+
+static int alloc_size;
+static char *memory;
+
+/* shared by the workers and the parent that unplugs a cpu */
+struct hotplug
+{
+	int started;	/* workers that are running */
+	int cpu;	/* the cpu that is offline, or -1 */
+	int on_offline;	/* rounds the workers ran on it meanwhile */
+};
+static volatile struct hotplug *hotplug;
+
+void segv_handler(int signal_number)
+{
+	mprotect(memory, alloc_size, PROT_READ | PROT_WRITE);
+}
+
+/* start trace, change scheduler and prepare the memory to write */
+static void setup(int policy)
+{
+	struct sched_param param;
+	struct sigaction sa;
+	pid_t pid = getpid();
+
+	syscall(START_TRACE, pid); // start trace
+
+	param.sched_priority = (policy == 1 || policy == 2) ? 99 : 0;
+	if (sched_setscheduler(pid, policy, &param))
+		printf("pid: %d, set scheduler failed: %s\n", pid, strerror(errno));
+
+	/* Init segv_handler to handle SIGSEGV */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	alloc_size = getpagesize();
+	memory = mmap(NULL, alloc_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
+/* bind the caller to cpu, or to every cpu if cpu is -1 */
+static int set_affinity(int cpu, int ncpus)
+{
+	unsigned long mask;
+
+	mask = cpu < 0 ? (ncpus >= 8 * (int)sizeof(mask) ? ~0UL : (1UL << ncpus) - 1) : 1UL << cpu;
+	return syscall(__NR_sched_setaffinity, 0, sizeof(mask), &mask);
+}
+
+static int get_cpu(void)
+{
+	unsigned int cpu = 0;
+
+	syscall(__NR_getcpu, &cpu, NULL, NULL);
+	return cpu;
+}
+
+/* a pinned worker returns the number of rounds it ran off its cpu */
+static int worker(int cpu, int ncpus, int rounds, int policy, int refree)
+{
+	int r, i, last, off, wrong = 0, migrations = 0, on_offline = 0;
+
+	setup(policy);
+	if (cpu >= 0 && set_affinity(cpu, ncpus))
+		printf("pid: %d, set affinity failed: %s\n", getpid(), strerror(errno));
+	__sync_fetch_and_add(&hotplug->started, 1);
+
+	last = get_cpu();
+	for (r = 0; r < rounds; r++)
+	{
+		/* free the pinned worker for a while, then pin it again */
+		if (refree && r == rounds / 3)
+			set_affinity(-1, ncpus);
+		if (refree && r == 2 * rounds / 3)
+			set_affinity(cpu, ncpus);
+
+		for (i = 0; i < 4; i++)
+		{
+			/* set protection */
+			mprotect(memory, alloc_size, PROT_READ);
+			/* try to write, will receive a SIGSEGV */
+			memory[0] = i;
+		}
+		usleep(r % 3 ? 0 : 100);
+
+		/* the cpu was offline before and after i was read */
+		off = hotplug->cpu;
+		i = get_cpu();
+		if (off >= 0 && i == off && hotplug->cpu == off)
+			on_offline++;
+		if (i != last)
+			migrations++;
+		last = i;
+
+		/* only check while the worker is pinned */
+		if (cpu >= 0 && i != cpu && !(refree && r >= rounds / 3 && r < 2 * rounds / 3))
+			wrong++;
+	}
+
+	syscall(STOP_TRACE, getpid()); // stop trace
+	__sync_fetch_and_add(&hotplug->on_offline, on_offline);
+
+	if (cpu >= 0)
+		printf("pinned pid: %d, cpu: %d, migrations: %d, rounds off cpu: %d\n",
+			   getpid(), cpu, migrations, wrong);
+	else
+		printf("free pid: %d, migrations: %d\n", getpid(), migrations);
+
+	return wrong || on_offline ? 1 : 0;
+}
+
+static int set_online(int cpu, int online)
+{
+	char path[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", online);
+	return fclose(f);
+}
+
+/* take cpu offline and back online once all workers have started */
+static int unplug(int cpu, int workers)
+{
+	while (hotplug->started < workers)
+		usleep(1000);
+
+	if (set_online(cpu, 0))
+	{
+		printf("hotplug: cpu %d, offline failed: %s, SKIPPED\n", cpu, strerror(errno));
+		return 0;
+	}
+	hotplug->cpu = cpu;
+	usleep(100000);
+	hotplug->cpu = -1;
+	if (set_online(cpu, 1))
+	{
+		printf("hotplug: cpu %d, online failed: %s\n", cpu, strerror(errno));
+		return -1;
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int pinned = 2 * ncpus, nfree = 2 * ncpus, rounds = 2000, policy = SCHED_RAS;
+	int i, opt, status, failed = 0, unplugging = 0, pin_cpus = ncpus, unplugged = 0;
+
+	while ((opt = getopt(argc, argv, "p:f:r:s:u")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			pinned = atoi(optarg);
+			break;
+		case 'f':
+			nfree = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			policy = atoi(optarg);
+			break;
+		case 'u':
+			unplugging = 1;
+			break;
+		default:
+			printf("usage: %s [-p pinned] [-f free] [-r rounds] [-s policy] [-u]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	hotplug = mmap(NULL, sizeof(*hotplug), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (hotplug == MAP_FAILED)
+		return 1;
+	hotplug->cpu = -1;
+
+	/* the last cpu goes offline, pin no worker to it */
+	if (unplugging && ncpus == 1)
+	{
+		printf("hotplug: one cpu, SKIPPED\n");
+		unplugging = 0;
+	}
+	if (unplugging)
+		pin_cpus = ncpus - 1;
+	fflush(stdout);
+
+	for (i = 0; i < pinned + nfree; i++)
+	{
+		if (fork() == 0)
+		{
+			if (i < pinned)
+				exit(worker(i % pin_cpus, ncpus, rounds, policy, i % 4 == 3));
+			exit(worker(-1, ncpus, rounds, policy, 0));
+		}
+	}
+
+	if (unplugging)
+	{
+		unplugged = unplug(ncpus - 1, pinned + nfree);
+		if (unplugged < 0)
+			failed++;
+	}
+
+	for (i = 0; i < pinned + nfree; i++)
+	{
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+
+	if (unplugged > 0)
+		printf("hotplug: cpu %d, rounds on it while offline: %d, %s\n",
+			   ncpus - 1, hotplug->on_offline, hotplug->on_offline ? "FAIL" : "OK");
+
+	printf("cpus: %d, pinned: %d, free: %d, failed: %d, %s\n",
+		   ncpus, pinned, nfree, failed, failed ? "FAIL" : "OK");
+	return failed ? 1 : 0;
+}
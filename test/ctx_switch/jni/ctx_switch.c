@@ -0,0 +1,215 @@
+/*
+Operating System Project 2: ctx_switch.c
+
+Measure the context switch cost of traced RAS tasks that keep taking
+write faults. Pairs of processes ping-pong a byte through two pipes,
+and every process does some traced page writes between two switches,
+so the write fault path and the scheduler touch the same task_struct.
+Run it on kernels with different task_struct layouts to compare them.
+
+Every pair first runs the round trips without faults as a baseline, then
+with them. The timing side also measures the faults alone, and their time
+is taken out of the faulting run, so the reported switch cost is not
+dominated by mprotect() and the SIGSEGV handler. The difference to the
+baseline is what the faults add to the switches themselves.
+
+usage: ctx_switch [-n pairs] [-r rounds] [-w writes] [-s policy]
+    -n  number of ping-pong pairs (default 2)
+    -r  round trips of every pair (default 100000)
+    -w  traced page writes between two switches (default 1)
+    -s  scheduling policy (default 6, SCHED_RAS)
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#endif
+
+#define SCHED_RAS 6
+
+static int alloc_size;
+static char *memory;
+
+void segv_handler(int signal_number)
+{
+	mprotect(memory, alloc_size, PROT_READ | PROT_WRITE);
+}
+
+/* start trace, change scheduler and prepare the memory to write */
+static void setup(int policy)
+{
+	struct sched_param param;
+	struct sigaction sa;
+	pid_t pid = getpid();
+
+	syscall(START_TRACE, pid); // start trace
+
+	param.sched_priority = (policy == 1 || policy == 2) ? 99 : 0;
+	if (sched_setscheduler(pid, policy, &param))
+		printf("pid: %d, set scheduler failed: %s\n", pid, strerror(errno));
+
+	/* Init segv_handler to handle SIGSEGV */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	alloc_size = getpagesize();
+	memory = mmap(NULL, alloc_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
+/* take n traced write faults */
+static void write_faults(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		/* set protection */
+		mprotect(memory, alloc_size, PROT_READ);
+		/* try to write, will receive a SIGSEGV */
+		memory[0] = i;
+	}
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ping-pong rounds times with writes faults on every side, return the time */
+static long long ping_pong(int out, int in, int rounds, int writes, int echo)
+{
+	long long start = now_ns();
+	char c = 0;
+	int r;
+
+	for (r = 0; r < rounds; r++)
+	{
+		if (echo)
+			read(in, &c, 1);
+		else
+			write(out, &c, 1);
+		write_faults(writes);
+		if (echo)
+			write(out, &c, 1);
+		else
+			read(in, &c, 1);
+	}
+	return now_ns() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	int pairs = 2, rounds = 100000, writes = 1, policy = SCHED_RAS;
+	int ping[2], pong[2], i, opt, ready[2];
+	long long base, elapsed, fault_ns;
+	char c = 0;
+
+	while ((opt = getopt(argc, argv, "n:r:w:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			pairs = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'w':
+			writes = atoi(optarg);
+			break;
+		case 's':
+			policy = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s [-n pairs] [-r rounds] [-w writes] [-s policy]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	/* every pair waits on this pipe so that all of them start together */
+	pipe(ready);
+
+	for (i = 0; i < pairs; i++)
+	{
+		pipe(ping);
+		pipe(pong);
+
+		if (fork() == 0)
+		{
+			/* the echo side */
+			close(ready[1]);
+			setup(policy);
+			read(ready[0], &c, 1);
+			ping_pong(pong[1], ping[0], rounds, 0, 1);
+			ping_pong(pong[1], ping[0], rounds, writes, 1);
+			syscall(STOP_TRACE, getpid()); // stop trace
+			exit(0);
+		}
+
+		if (fork() == 0)
+		{
+			/* the timing side */
+			close(ready[1]);
+			setup(policy);
+
+			/* the cost of a fault without switching, before the pairs start */
+			fault_ns = 0;
+			if (writes)
+			{
+				fault_ns = now_ns();
+				write_faults(rounds * writes);
+				fault_ns = (now_ns() - fault_ns) / ((long long)rounds * writes);
+			}
+
+			read(ready[0], &c, 1);
+			base = ping_pong(ping[1], pong[0], rounds, 0, 0);
+			elapsed = ping_pong(ping[1], pong[0], rounds, writes, 0);
+			/* both sides fault writes times in every round trip */
+			elapsed -= 2LL * rounds * writes * fault_ns;
+
+			printf("pair %d: %d round trips, %lldns per round trip, %lldns per switch, "
+				   "%lldns per switch without faults, %lldns added by faults, %lldns per fault\n",
+				   i, rounds, elapsed / rounds, elapsed / rounds / 2, base / rounds / 2,
+				   (elapsed - base) / rounds / 2, fault_ns);
+			syscall(STOP_TRACE, getpid()); // stop trace
+			exit(0);
+		}
+
+		close(ping[0]);
+		close(ping[1]);
+		close(pong[0]);
+		close(pong[1]);
+	}
+
+	/* let every process reach its policy, then start them all */
+	sleep(1);
+	close(ready[1]);
+
+	for (i = 0; i < 2 * pairs; i++)
+	{
+		wait(0);
+	}
+	return 0;
+}
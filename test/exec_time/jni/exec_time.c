@@ -12,10 +12,21 @@ compare the performance of different schedulers.
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sched.h>
 #include <stdlib.h>
+#include <time.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#endif
 
 #define SCHED_NORMAL 0
 #define SCHED_FIFO 1
@@ -145,7 +156,7 @@ void new_processes(int n, int policy, int randnum[])
 		if ((pid = fork()) == 0)
 		{
 			pid = getpid();
-			syscall(361, pid); // start trace
+			syscall(START_TRACE, pid); // start trace
 
 			set_policy(pid, policy, &param); // change scheduler
 
@@ -163,7 +174,7 @@ void new_processes(int n, int policy, int randnum[])
 			
 			sleep(1);
 
-			syscall(362, pid); // stop trace
+			syscall(STOP_TRACE, pid); // stop trace
 			exit(0);
 		}
 		else
@@ -0,0 +1,270 @@
+/*
+Operating System Project 2: futex_contention.c
+
+Test the contention tracking of the RAS scheduler. Threads take a shared
+pthread mutex (a futex) in a loop, so they keep blocking on and waking
+each other. Before exiting, every thread prints the tasks that woke it,
+how often and how long it was blocked and how many pages each of them
+wrote, from the RAS_CTL_GET_CONTENTION operation of system call ras_ctl
+(378).
+
+The run is done twice, with /proc/sys/kernel/sched_ras_contention at 0
+(counted only) and at the threshold given with -c (acted on: a woken
+waiter runs next on the cpu of the thread that handed it the mutex). On
+more than one cpu, the test fails unless acting on the contention runs
+more handoffs on the cpu of the previous holder. It also fails if the
+wakeups of a pipe, which are no lock handoffs, are counted as contention.
+
+usage: futex_contention [-t threads] [-i iterations] [-s policy] [-c threshold]
+    -t  number of threads (default 2 per cpu)
+    -i  critical sections of every thread (default 20000)
+    -s  scheduling policy (default 6, SCHED_RAS)
+    -c  sched_ras_contention of the second run (default 4)
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define RAS_CTL 184
+#else
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_GET_CONTENTION 8
+#define RAS_NR_CONTENDERS 4
+
+#define SCHED_RAS 6
+#define CONTENTION "/proc/sys/kernel/sched_ras_contention"
+#define PIPE_ROUNDS 1000
+
+struct ras_contender
+{
+	int pid;
+	unsigned int count;
+	unsigned long long wait_ns;
+	int wcounts;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile long counter;
+static volatile int holder_tid, holder_cpu; /* the last thread in the critical section */
+static long handoffs, colocated;
+static int policy = SCHED_RAS, iterations = 20000, verbose;
+
+static void set_policy(int tid)
+{
+	struct sched_param param;
+
+	param.sched_priority = (policy == 1 || policy == 2) ? 99 : 0;
+	if (sched_setscheduler(0, policy, &param))
+		printf("tid: %d, set scheduler failed: %s\n", tid, strerror(errno));
+}
+
+static void *worker(void *arg)
+{
+	struct ras_contender c[RAS_NR_CONTENDERS];
+	long my_handoffs = 0, my_colocated = 0;
+	int tid = syscall(__NR_gettid);
+	int i, j, n, cpu;
+
+	set_policy(tid);
+
+	for (i = 0; i < iterations; i++)
+	{
+		pthread_mutex_lock(&lock);
+		/* the mutex came from another thread, count where it runs */
+		cpu = sched_getcpu();
+		if (holder_tid != tid)
+		{
+			my_handoffs++;
+			if (cpu == holder_cpu)
+				my_colocated++;
+		}
+		holder_tid = tid;
+		holder_cpu = cpu;
+		for (j = 0; j < 100; j++)
+			counter++;
+		pthread_mutex_unlock(&lock);
+	}
+
+	__sync_fetch_and_add(&handoffs, my_handoffs);
+	__sync_fetch_and_add(&colocated, my_colocated);
+
+	if (!verbose)
+		return NULL;
+
+	n = syscall(RAS_CTL, RAS_CTL_GET_CONTENTION, tid, c, RAS_NR_CONTENDERS);
+
+	pthread_mutex_lock(&print_lock);
+	if (n < 0)
+		printf("tid: %d, get contention failed: %s\n", tid, strerror(errno));
+	for (i = 0; i < n; i++)
+	{
+		if (c[i].pid)
+			printf("tid: %d, woken by: %d, count: %u, blocked: %lluus, wcounts: %d\n",
+				   tid, c[i].pid, c[i].count, c[i].wait_ns / 1000, c[i].wcounts);
+	}
+	pthread_mutex_unlock(&print_lock);
+
+	return NULL;
+}
+
+static int read_contention(void)
+{
+	FILE *f = fopen(CONTENTION, "r");
+	int value = 0;
+
+	if (f)
+	{
+		if (fscanf(f, "%d", &value) != 1)
+			value = 0;
+		fclose(f);
+	}
+	return value;
+}
+
+static int write_contention(int value)
+{
+	FILE *f = fopen(CONTENTION, "w");
+
+	if (!f)
+		return -1;
+	fprintf(f, "%d\n", value);
+	return fclose(f);
+}
+
+/* one run of the threads, returns the percentage of colocated handoffs */
+static int run(int contention, int threads, int *failed)
+{
+	struct timespec start, end;
+	pthread_t *tids = calloc(threads, sizeof(*tids));
+	int i, pct;
+
+	if (write_contention(contention))
+		printf("futex_contention: set %s failed: %s\n", CONTENTION, strerror(errno));
+
+	counter = 0;
+	handoffs = 0;
+	colocated = 0;
+	holder_tid = 0;
+	verbose = contention != 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, worker, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (counter != (long)threads * iterations * 100)
+		(*failed)++;
+	pct = handoffs ? colocated * 100 / handoffs : 0;
+
+	printf("futex_contention: contention: %d, threads: %d, makespan: %ldms, colocated: %d%%, %s\n",
+		   contention, threads,
+		   (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000, pct,
+		   counter == (long)threads * iterations * 100 ? "OK" : "FAIL");
+
+	free(tids);
+	return pct;
+}
+
+static int pipe_fds[2];
+
+static void *pipe_writer(void *arg)
+{
+	char c = 0;
+	int i;
+
+	set_policy(syscall(__NR_gettid));
+	for (i = 0; i < PIPE_ROUNDS; i++)
+	{
+		write(pipe_fds[1], &c, 1);
+		usleep(100);
+	}
+	return arg;
+}
+
+/* the contention counted on a thread woken only through a pipe */
+static int pipe_contention(void)
+{
+	struct ras_contender c[RAS_NR_CONTENDERS];
+	int tid = syscall(__NR_gettid);
+	pthread_t writer;
+	int i, n, count = 0;
+	char buf;
+
+	if (pipe(pipe_fds))
+		return -1;
+
+	set_policy(tid);
+	pthread_create(&writer, NULL, pipe_writer, NULL);
+	for (i = 0; i < PIPE_ROUNDS; i++)
+		read(pipe_fds[0], &buf, 1);
+	pthread_join(writer, NULL);
+
+	n = syscall(RAS_CTL, RAS_CTL_GET_CONTENTION, tid, c, RAS_NR_CONTENDERS);
+	for (i = 0; i < n; i++)
+		count += c[i].count;
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+	return n < 0 ? -1 : count;
+}
+
+int main(int argc, char *argv[])
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = 2 * ncpus, threshold = 4, opt, failed = 0;
+	int saved = read_contention();
+	int counted, acted, piped, ok;
+
+	while ((opt = getopt(argc, argv, "t:i:s:c:")) != -1)
+	{
+		switch (opt)
+		{
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			policy = atoi(optarg);
+			break;
+		case 'c':
+			threshold = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s [-t threads] [-i iterations] [-s policy] [-c threshold]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	counted = run(0, threads, &failed);
+	acted = run(threshold, threads, &failed);
+	write_contention(saved);
+
+	piped = pipe_contention();
+
+	/* acting on the contention keeps handoffs on the cpu of the holder,
+	   which only makes a difference with more than one cpu */
+	ok = (ncpus == 1 || acted > counted) && piped == 0;
+	if (!ok)
+		failed++;
+	printf("futex_contention: colocated: %d%% -> %d%%, pipe wakeups counted: %d, %s\n",
+		   counted, acted, piped, ok ? "OK" : "FAIL");
+
+	return failed ? 1 : 0;
+}
@@ -1,8 +1,11 @@
 /*
 Operating System Project 2: mem_test.c
 
-Use the three system call(361 362 363) to trace memory write.
-Test the page access tracing mechanism.
+Use the system call(361 362 363 378) to trace memory write.
+Test the page access tracing mechanism, the writes by kind and the
+sampling of the writes over two intervals with the RAS_CTL_GET_TRACE_TYPES
+and RAS_CTL_SAMPLE_TRACE operations of ras_ctl (378). The samples are
+cumulative, the writes of an interval are the difference of two of them.
 */
 
 #include <fcntl.h>
@@ -15,6 +18,31 @@ Test the page access tracing mechanism.
 #include <unistd.h>
 #include <stdlib.h>
 
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#define GET_TRACE 183
+#define RAS_CTL 184
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#define GET_TRACE 363
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_GET_TRACE_TYPES 6
+#define RAS_CTL_SAMPLE_TRACE 10
+
+struct ras_trace_sample
+{
+	int pid;
+	int traced;
+	int wcounts;
+	int wcounts_type[4];
+	unsigned long long start_ns;
+	unsigned long long now_ns;
+};
+
 static int alloc_size;
 static char *memory;
 static int times;
@@ -32,11 +60,15 @@ int main()
 	int fd;
 	struct sigaction sa;
 	int wcount = 0;
+	int types[4] = {0};
+	struct ras_trace_sample sample[3];
+	int interval[2];
+	pid_t pid = getpid();
 
 	printf("Start memory trace testing program!\n");
 
 	/* start trace */
-	syscall(361, getpid());
+	syscall(START_TRACE, getpid());
 
 	/* Init segv_handler to handle SIGSEGV */
 	memset(&sa, 0, sizeof(sa));
@@ -44,6 +76,7 @@ int main()
 	sigaction(SIGSEGV, &sa, NULL);
 
 	times = 0;
+	syscall(RAS_CTL, RAS_CTL_SAMPLE_TRACE, &pid, 1, &sample[0]); // the start of the first interval
 
 	/* allocate memory for process, set the memory can only be read */
 	alloc_size = 10 * getpagesize();
@@ -53,19 +86,32 @@ int main()
 	/* try to write, will receive a SIGSEGV */
 	memory[0] = 0;
 	printf("memory[0] = %d\n", memory[0]);
+	syscall(RAS_CTL, RAS_CTL_SAMPLE_TRACE, &pid, 1, &sample[1]); // the end of the first interval
 
 	/* set protection */
 	mprotect(memory, alloc_size, PROT_READ);
 	/* try to write, will receive a SIGSEGV */
 	memory[0] = 1;
 	printf("memory[0] = %d\n", memory[0]);
+	syscall(RAS_CTL, RAS_CTL_SAMPLE_TRACE, &pid, 1, &sample[2]); // the end of the second interval
 
 	/* stop trace */
-	syscall(362, getpid());
+	syscall(STOP_TRACE, getpid());
 
 	/* Get wcount */
-	syscall(363, getpid(), &wcount);
+	syscall(GET_TRACE, getpid(), &wcount);
 	printf("Task pid : %d, Wcount = %d, times = %d\n", getpid(), wcount, times);
+	/* every SIGSEGV is a protection write, the retried writes fault again */
+	syscall(RAS_CTL, RAS_CTL_GET_TRACE_TYPES, getpid(), types, 4);
+	printf("protection = %d, cow = %d, anon = %d, shared = %d\n",
+		types[0], types[1], types[2], types[3]);
+	interval[0] = sample[1].wcounts - sample[0].wcounts;
+	interval[1] = sample[2].wcounts - sample[1].wcounts;
+	printf("samples = %d in %lluus + %d in %lluus, %s\n",
+		interval[0], (sample[1].now_ns - sample[0].now_ns) / 1000,
+		interval[1], (sample[2].now_ns - sample[1].now_ns) / 1000,
+		interval[0] + interval[1] == wcount && sample[2].wcounts == wcount &&
+		sample[0].start_ns == sample[2].start_ns ? "OK" : "FAIL");
 	/* free */
 	munmap(memory, alloc_size);
 	return 0;
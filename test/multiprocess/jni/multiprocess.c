@@ -11,10 +11,21 @@ Fork several child tasks to test the RAS scheduler.
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sched.h>
 #include <stdlib.h>
+#include <time.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#endif
 
 #define SCHED_NORMAL 0
 #define SCHED_FIFO 1
@@ -151,7 +162,7 @@ int main()
 		{
 			sleep(1);
 			pid = getpid();
-			syscall(361, pid); // start trace
+			syscall(START_TRACE, pid); // start trace
 
 			/* change wcounts by randomly writing to memory */
 			memory_write(randnum[i]);
@@ -164,7 +175,7 @@ int main()
 			/* do something to consume timeslice and
 			   change wcounts by randomly writing to memory */
 			memory_write(1000);
-			syscall(362, pid); // stop trace
+			syscall(STOP_TRACE, pid); // stop trace
 
 			exit(0);
 		}
@@ -0,0 +1,122 @@
+/*
+Operating System Project 2: notify_test.c
+
+Use the RAS_CTL_NOTIFY operation of system call ras_ctl (378) to be notified through an eventfd when a child
+process writes too many pages, instead of polling get_trace(363).
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#define GET_TRACE 183
+#define RAS_CTL 184
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#define GET_TRACE 363
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_NOTIFY 3
+#define RAS_NOTIFY_WEIGHT 1
+
+static int alloc_size;
+static char *memory;
+
+void segv_handler(int signal_number)
+{
+	mprotect(memory, alloc_size, PROT_READ | PROT_WRITE);
+}
+
+/* randomly write data to memory, slowly */
+void memory_write(int n)
+{
+	int fd, i;
+	struct sigaction sa;
+
+	/* Init segv_handler to handle SIGSEGV */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	/* allocate memory for process, set the memory can only be read */
+	alloc_size = 10 * getpagesize();
+	fd = open("/dev/zero", O_RDONLY);
+	memory = mmap(NULL, alloc_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	for (i = 0; i < n; i++)
+	{
+		/* set protection */
+		mprotect(memory, alloc_size, PROT_READ);
+		/* try to write, will receive a SIGSEGV */
+		memory[rand() % alloc_size] = i;
+		usleep(1000);
+	}
+
+	/* free */
+	munmap(memory, alloc_size);
+}
+
+int main()
+{
+	pid_t pid;
+	int efd, wthreshold, rate_threshold, wcount = 0, n;
+	struct pollfd pfd;
+	uint64_t events;
+
+	printf("Please input the wcounts threshold and the rate threshold (writes/s): ");
+	scanf("%d %d", &wthreshold, &rate_threshold);
+
+	if ((pid = fork()) == 0)
+	{
+		sleep(1);
+		memory_write(2000);
+		exit(0);
+	}
+
+	/* start trace and register the eventfd for the child */
+	syscall(START_TRACE, pid);
+	efd = eventfd(0, 0);
+	if (syscall(RAS_CTL, RAS_CTL_NOTIFY, pid, efd, wthreshold, rate_threshold, RAS_NOTIFY_WEIGHT))
+	{
+		printf("ras_notify failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	pfd.fd = efd;
+	pfd.events = POLLIN;
+
+	/* sleep until the kernel wakes us up, no polling of get_trace */
+	for (;;)
+	{
+		n = poll(&pfd, 1, 5000);
+		if (n <= 0)
+			break;
+		read(efd, &events, sizeof(events));
+		syscall(GET_TRACE, pid, &wcount);
+		printf("notified %llu time(s), pid: %d, wcounts: %d\n",
+			   (unsigned long long)events, pid, wcount);
+	}
+
+	syscall(STOP_TRACE, pid);
+	syscall(RAS_CTL, RAS_CTL_NOTIFY, pid, -1, 0, 0, 0);
+	wait(0);
+	close(efd);
+	return 0;
+}
@@ -0,0 +1,428 @@
+/*
+Operating System Project 2: race_workload.c
+
+Fork several workers over one shared mapping to create real races
+between processes, and measure the conflict rate under different schedulers.
+
+usage: race_workload [-n workers] [-p pages] [-o overlap%] [-w write%]
+                     [-m 0(lock)|1(cas)|2(both)] [-i ops] [-f fault_interval]
+                     [-s policy]
+
+    -n  number of worker processes (default 10)
+    -p  number of pages in the shared mapping (default 10)
+    -o  percentage of accesses that go to the shared hot pages (default 50)
+    -w  percentage of accesses that are updates (default 50)
+    -m  update method: spin lock, lock-free CAS or both (default 2)
+    -i  accesses done by every worker (default 100000)
+    -f  make every f-th update fault so that the tracer sees it, 0 disables
+        (default 64)
+    -s  only run the given policy (default: NORMAL, FIFO, RR and RAS)
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <linux/perf_event.h>
+
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define STOP_TRACE 182
+#define GET_TRACE 183
+#else
+#define START_TRACE 361
+#define STOP_TRACE 362
+#define GET_TRACE 363
+#endif
+
+#define SCHED_NORMAL 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+#define SCHED_BATCH 3
+#define SCHED_IDLE 5
+#define SCHED_RAS 6
+
+#define MODE_LOCK 0
+#define MODE_CAS 1
+
+/* spin this many times on a busy lock before giving the cpu away */
+#define SPIN_BEFORE_YIELD 100
+
+char *SCHED_NAME[] = {"SCHED_NORMAL", "SCHED_FIFO", "SCHED_RR",
+					  "SCHED_BATCH", "", "SCHED_IDLE", "SCHED_RAS"};
+char *MODE_NAME[] = {"lock", "cas"};
+
+/* header of every page in the shared mapping */
+struct shared_page
+{
+	volatile int lock;
+	volatile long value;
+};
+
+/* statistics of one worker, kept in a shared mapping for the parent */
+struct worker_stat
+{
+	pid_t pid;
+	long reads;
+	long writes;
+	long conflicts;		 /* cas failures or contended lock acquisitions */
+	long long wait_ns;	 /* time spent waiting for a busy lock */
+	long long cache_misses; /* -1 if the counter is not available */
+	int wcounts;
+	long elapsed_ms;
+};
+
+static int nr_workers = 10;
+static int nr_pages = 10;
+static int overlap = 50;
+static int write_ratio = 50;
+static int ops = 100000;
+static int fault_interval = 64;
+
+static int page_size;
+static int alloc_size;
+static char *memory;
+static struct worker_stat *stats;
+
+/* set scheduler and handle exception */
+static void set_policy(pid_t pid, int policy, struct sched_param *param)
+{
+	if (sched_setscheduler(pid, policy, param))
+	{
+		switch (errno)
+		{
+		case EINVAL:
+			printf("The value of the policy parameter is invalid, or one or more of the parameters contained in param is outside the valid range for the specified scheduling policy. \n");
+			break;
+		case ENOSYS:
+			printf("The function sched_setscheduler() is not supported by this implementation. \n");
+			break;
+		case EPERM:
+			printf("The requesting process does not have permission to set either or both of the scheduling parameters or the scheduling policy of the specified process. \n");
+			break;
+		case ESRCH:
+			printf("No process can be found corresponding to that specified by pid. \n");
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void segv_handler(int signal_number)
+{
+	mprotect(memory, alloc_size, PROT_READ | PROT_WRITE);
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* open a hardware cache-miss counter for the calling process, -1 if none */
+static int open_cache_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* pick the page of the next access: a hot page or the worker's own page */
+static struct shared_page *pick_page(int id)
+{
+	int hot_pages, cold_pages, n;
+
+	hot_pages = nr_pages * overlap / 100;
+	if (hot_pages == 0)
+		hot_pages = 1;
+	cold_pages = nr_pages - hot_pages;
+
+	if (cold_pages == 0 || rand() % 100 < overlap)
+		n = rand() % hot_pages;
+	else
+		n = hot_pages + id % cold_pages;
+
+	return (struct shared_page *)(memory + n * page_size);
+}
+
+static void update_lock(struct shared_page *pg, struct worker_stat *st)
+{
+	long long start;
+	int spins = 0;
+
+	if (__sync_lock_test_and_set(&pg->lock, 1))
+	{
+		/* the lock is busy, record how long we wait for it */
+		st->conflicts++;
+		start = now_ns();
+		while (__sync_lock_test_and_set(&pg->lock, 1))
+		{
+			if (++spins == SPIN_BEFORE_YIELD)
+			{
+				spins = 0;
+				sched_yield();
+			}
+		}
+		st->wait_ns += now_ns() - start;
+	}
+
+	pg->value++;
+	__sync_lock_release(&pg->lock);
+}
+
+static void update_cas(struct shared_page *pg, struct worker_stat *st)
+{
+	long old;
+
+	for (;;)
+	{
+		old = pg->value;
+		if (__sync_bool_compare_and_swap(&pg->value, old, old + 1))
+			break;
+		st->conflicts++;
+	}
+}
+
+/* body of a worker process */
+static void worker(int id, int policy, int mode)
+{
+	struct sched_param param;
+	struct sigaction sa;
+	struct worker_stat *st = &stats[id];
+	struct shared_page *pg;
+	long long start;
+	long sink = 0;
+	int fd, i;
+	pid_t pid;
+
+	pid = getpid();
+	st->pid = pid;
+	srand(pid);
+
+	syscall(START_TRACE, pid); // start trace
+
+	param.sched_priority = (policy == SCHED_FIFO || policy == SCHED_RR) ? 99 : 0;
+	set_policy(pid, policy, &param); // change scheduler
+
+	/* Init segv_handler to handle SIGSEGV */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	fd = open_cache_counter();
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	start = now_ns();
+	for (i = 0; i < ops; i++)
+	{
+		pg = pick_page(id);
+
+		if (rand() % 100 >= write_ratio)
+		{
+			sink += pg->value;
+			st->reads++;
+			continue;
+		}
+
+		/* let the page access tracing mechanism see this write */
+		if (fault_interval && st->writes % fault_interval == 0)
+			mprotect(memory, alloc_size, PROT_READ);
+
+		if (mode == MODE_LOCK)
+			update_lock(pg, st);
+		else
+			update_cas(pg, st);
+		st->writes++;
+	}
+	st->elapsed_ms = (now_ns() - start) / 1000000;
+
+	st->cache_misses = -1;
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &st->cache_misses, sizeof(st->cache_misses)) != sizeof(st->cache_misses))
+			st->cache_misses = -1;
+		close(fd);
+	}
+
+	syscall(STOP_TRACE, pid); // stop trace
+	syscall(GET_TRACE, pid, &st->wcounts); // get trace
+
+	(void)sink;
+	exit(0);
+}
+
+/* run all workers under one scheduler and print the conflict statistics */
+static void run(int policy, int mode)
+{
+	struct worker_stat total;
+	struct shared_page *pg;
+	long long misses = 0;
+	long sum = 0, max_ms = 0;
+	int i, have_misses = 1;
+	pid_t pid;
+
+	memset(memory, 0, alloc_size);
+	memset(stats, 0, nr_workers * sizeof(struct worker_stat));
+
+	for (i = 0; i < nr_workers; i++)
+	{
+		if ((pid = fork()) == 0)
+			worker(i, policy, mode);
+		else if (pid < 0)
+			printf("fork failed: %s\n", strerror(errno));
+	}
+	for (i = 0; i < nr_workers; i++)
+	{
+		wait(0);
+	}
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < nr_workers; i++)
+	{
+		total.reads += stats[i].reads;
+		total.writes += stats[i].writes;
+		total.conflicts += stats[i].conflicts;
+		total.wait_ns += stats[i].wait_ns;
+		if (stats[i].cache_misses < 0)
+			have_misses = 0;
+		else
+			misses += stats[i].cache_misses;
+		if (stats[i].elapsed_ms > max_ms)
+			max_ms = stats[i].elapsed_ms;
+		printf("pid: %d, writes: %ld, conflicts: %ld, wcounts: %d, %ldms\n",
+			   stats[i].pid, stats[i].writes, stats[i].conflicts,
+			   stats[i].wcounts, stats[i].elapsed_ms);
+	}
+
+	/* no update may be lost, whatever the scheduler did */
+	for (i = 0; i < nr_pages; i++)
+	{
+		pg = (struct shared_page *)(memory + i * page_size);
+		sum += pg->value;
+	}
+
+	printf("%s-%s: workers: %d, reads: %ld, writes: %ld, lost: %ld\n",
+		   SCHED_NAME[policy], MODE_NAME[mode], nr_workers,
+		   total.reads, total.writes, total.writes - sum);
+	printf("%s-%s: conflicts: %ld, conflict rate: %.2f%%, lock wait: %lldus, makespan: %ldms\n",
+		   SCHED_NAME[policy], MODE_NAME[mode], total.conflicts,
+		   total.writes ? 100.0 * total.conflicts / total.writes : 0.0,
+		   total.wait_ns / 1000, max_ms);
+	if (have_misses)
+		printf("%s-%s: cache misses: %lld\n", SCHED_NAME[policy], MODE_NAME[mode], misses);
+	else
+		printf("%s-%s: cache misses: not available\n", SCHED_NAME[policy], MODE_NAME[mode]);
+	printf("\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int policy[4] = {0, 1, 2, 6};
+	int only_policy = -1, modes = 2;
+	int i, m, opt;
+
+	while ((opt = getopt(argc, argv, "n:p:o:w:m:i:f:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			nr_workers = atoi(optarg);
+			break;
+		case 'p':
+			nr_pages = atoi(optarg);
+			break;
+		case 'o':
+			overlap = atoi(optarg);
+			break;
+		case 'w':
+			write_ratio = atoi(optarg);
+			break;
+		case 'm':
+			modes = atoi(optarg);
+			break;
+		case 'i':
+			ops = atoi(optarg);
+			break;
+		case 'f':
+			fault_interval = atoi(optarg);
+			break;
+		case 's':
+			only_policy = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s [-n workers] [-p pages] [-o overlap%%] [-w write%%] "
+				   "[-m 0|1|2] [-i ops] [-f fault_interval] [-s policy]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_workers < 1 || nr_pages < 1 || overlap < 0 || overlap > 100 ||
+		write_ratio < 0 || write_ratio > 100 || modes < 0 || modes > 2 ||
+		ops < 0 || fault_interval < 0)
+	{
+		printf("invalid arguments\n");
+		return 1;
+	}
+
+	/* one shared mapping for the data and one for the statistics */
+	page_size = getpagesize();
+	alloc_size = nr_pages * page_size;
+	memory = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	stats = mmap(NULL, nr_workers * sizeof(struct worker_stat), PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED || stats == MAP_FAILED)
+	{
+		printf("mmap failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	printf("workers: %d, pages: %d, overlap: %d%%, write ratio: %d%%, ops: %d\n\n",
+		   nr_workers, nr_pages, overlap, write_ratio, ops);
+
+	/* compare the conflict rate of different schedulers */
+	for (i = 0; i < 4; i++)
+	{
+		if (only_policy >= 0 && policy[i] != only_policy)
+			continue;
+		for (m = MODE_LOCK; m <= MODE_CAS; m++)
+		{
+			if (modes != 2 && modes != m)
+				continue;
+			run(policy[i], m);
+			sleep(1);
+		}
+	}
+
+	munmap(memory, alloc_size);
+	munmap(stats, nr_workers * sizeof(struct worker_stat));
+	return 0;
+}
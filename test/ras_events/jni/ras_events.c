@@ -0,0 +1,203 @@
+/*
+Operating System Project 2: ras_events.c
+
+Collect the per-cpu RAS event buffers (/proc/ras_events/cpu<N>) to disk.
+The buffers are mapped read-only and written to <prefix>.cpu<N> as raw
+struct ras_event records, without going through printk.
+
+usage: ras_events [-t seconds] [-o prefix] [-p]
+    -t  how long to collect (default 10)
+    -o  prefix of the output files (default /data/local/ras_events)
+    -p  also print every event
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MAX_CPUS 32
+
+/* same layout as kernel/sched/ras_events.c */
+struct ras_event
+{
+	uint64_t time;
+	int32_t pid;
+	uint16_t type;
+	uint16_t arg;
+};
+
+struct ras_event_header
+{
+	volatile uint32_t head;
+	uint32_t nr_events;
+	uint32_t event_size;
+	uint32_t cpu;
+};
+
+char *EVENT_NAME[] = {"", "enqueue", "dequeue", "pick", "preempt",
+					  "expire", "migrate", "weight", "write"};
+
+struct cpu_buffer
+{
+	int fd;
+	int out;
+	struct ras_event_header *hdr;
+	struct ras_event *events;
+	size_t size;
+	uint32_t tail;
+	unsigned long long collected;
+	unsigned long long lost;
+};
+
+static struct cpu_buffer buffers[MAX_CPUS];
+static int page_size;
+
+/* write the events [tail, head) of one cpu to its output file */
+static void drain(struct cpu_buffer *buf, int print)
+{
+	uint32_t head, start, nr = buf->hdr->nr_events, first, count, i;
+	struct ras_event *e;
+
+	head = buf->hdr->head;
+	__sync_synchronize(); /* read head before the events */
+
+	if (head - buf->tail > nr)
+	{
+		/* the kernel overwrote events we have not read yet */
+		buf->lost += head - buf->tail - nr;
+		buf->tail = head - nr;
+	}
+
+	start = buf->tail;
+	while (buf->tail != head)
+	{
+		first = buf->tail % nr;
+		count = head - buf->tail;
+		if (count > nr - first)
+			count = nr - first;
+
+		write(buf->out, &buf->events[first], count * sizeof(struct ras_event));
+
+		if (print)
+		{
+			for (i = 0; i < count; i++)
+			{
+				e = &buf->events[first + i];
+				printf("cpu: %u, time: %llu, pid: %d, %s, arg: %u\n", buf->hdr->cpu,
+					   (unsigned long long)e->time, e->pid,
+					   e->type <= 8 ? EVENT_NAME[e->type] : "?", e->arg);
+			}
+		}
+
+		buf->tail += count;
+		buf->collected += count;
+	}
+
+	/* events overwritten while we were copying them are torn, count them as lost */
+	__sync_synchronize();
+	head = buf->hdr->head;
+	if (head - start > nr)
+		buf->lost += head - start - nr;
+}
+
+int main(int argc, char *argv[])
+{
+	char name[256], *prefix = "/data/local/ras_events";
+	int seconds = 10, print = 0, nr_cpus = 0, cpu, opt;
+	struct cpu_buffer *buf;
+	struct ras_event_header *hdr;
+	time_t end;
+
+	while ((opt = getopt(argc, argv, "t:o:p")) != -1)
+	{
+		switch (opt)
+		{
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'o':
+			prefix = optarg;
+			break;
+		case 'p':
+			print = 1;
+			break;
+		default:
+			printf("usage: %s [-t seconds] [-o prefix] [-p]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	page_size = getpagesize();
+
+	/* map the buffer of every cpu, opening them enables the recording */
+	for (cpu = 0; cpu < MAX_CPUS; cpu++)
+	{
+		buf = &buffers[nr_cpus];
+		sprintf(name, "/proc/ras_events/cpu%d", cpu);
+		buf->fd = open(name, O_RDONLY);
+		if (buf->fd < 0)
+			continue;
+
+		/* map the header first to learn the size of the buffer */
+		hdr = mmap(NULL, page_size, PROT_READ, MAP_SHARED, buf->fd, 0);
+		if (hdr == MAP_FAILED)
+		{
+			printf("mmap %s failed: %s\n", name, strerror(errno));
+			return 1;
+		}
+		buf->size = page_size + hdr->nr_events * hdr->event_size;
+		munmap(hdr, page_size);
+
+		buf->hdr = mmap(NULL, buf->size, PROT_READ, MAP_SHARED, buf->fd, 0);
+		if (buf->hdr == MAP_FAILED)
+		{
+			printf("mmap %s failed: %s\n", name, strerror(errno));
+			return 1;
+		}
+		buf->events = (struct ras_event *)((char *)buf->hdr + page_size);
+		buf->tail = buf->hdr->head;
+
+		sprintf(name, "%s.cpu%d", prefix, cpu);
+		buf->out = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (buf->out < 0)
+		{
+			printf("open %s failed: %s\n", name, strerror(errno));
+			return 1;
+		}
+		nr_cpus++;
+	}
+
+	if (nr_cpus == 0)
+	{
+		printf("No RAS event buffer found in /proc/ras_events\n");
+		return 1;
+	}
+	printf("Collecting RAS events of %d cpu(s) for %ds\n", nr_cpus, seconds);
+
+	end = time(NULL) + seconds;
+	while (time(NULL) < end)
+	{
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			drain(&buffers[cpu], print);
+		usleep(100000);
+	}
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+	{
+		buf = &buffers[cpu];
+		drain(buf, print);
+		printf("cpu: %u, events: %llu, lost: %llu\n", buf->hdr->cpu, buf->collected, buf->lost);
+		munmap(buf->hdr, buf->size);
+		close(buf->out);
+		close(buf->fd);
+	}
+	return 0;
+}
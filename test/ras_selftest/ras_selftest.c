@@ -0,0 +1,211 @@
+/*
+Operating System Project 2: ras_selftest.c
+
+Self-test of the bookkeeping of the RAS run queues under stress.
+It spawns nr_threads kernel threads that randomly sleep, write (raise
+their wcounts), migrate, switch between SCHED_NORMAL and SCHED_RAS, yield
+and yield to another thread for duration seconds, while the bookkeeping of every run queue is
+checked with ras_check_rq() (ras_nr_running, total_wcounts, total_weight
+and time_slice against the queued tasks).
+At the end it prints the broken invariants and the average cost of every
+operation, and fails to load if an invariant was broken.
+
+usage: insmod ras_selftest.ko [nr_threads=N] [duration=seconds]
+*/
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/cpumask.h>
+
+MODULE_LICENSE("Dual BSD/GPL");
+
+static int nr_threads;
+module_param(nr_threads, int, 0444);
+MODULE_PARM_DESC(nr_threads, "number of stress threads (default 4 per online cpu)");
+
+static int duration = 10;
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "seconds of stress (default 10)");
+
+enum
+{
+    OP_SLEEP,
+    OP_WRITE,
+    OP_MIGRATE,
+    OP_POLICY,
+    OP_YIELD,
+    OP_YIELD_TO,
+    NR_OPS,
+};
+
+static const char *op_name[NR_OPS] = {"sleep", "write", "migrate", "policy", "yield", "yield_to"};
+
+struct stress
+{
+    struct task_struct *tsk;
+    unsigned long ops[NR_OPS];
+    u64 ns[NR_OPS];
+    u64 sleep_late_ns;  /* slept longer than asked for, wakeup latency */
+};
+
+/* every thread, for OP_YIELD_TO, filled while the threads start */
+static struct stress *stress_all;
+
+static void stress_op(struct stress *st, int op)
+{
+    struct sched_param param = { .sched_priority = 0 };
+    unsigned int timeout;
+    struct task_struct *target;
+    u64 start, asked;
+    int cpu;
+
+    start = local_clock();
+
+    switch (op)
+    {
+    case OP_SLEEP:
+        timeout = random32() % 3;
+        asked = (u64)jiffies_to_usecs(timeout) * NSEC_PER_USEC;
+        schedule_timeout_uninterruptible(timeout);
+        if (local_clock() - start > asked)
+            st->sleep_late_ns += local_clock() - start - asked;
+        break;
+    case OP_WRITE:
+        /* what traced write faults do to a kernel thread without mm */
+        current->wcounts += random32() % 64;
+        break;
+    case OP_MIGRATE:
+        if (random32() % 2)
+        {
+            set_cpus_allowed_ptr(current, cpu_online_mask);
+            break;
+        }
+        cpu = cpumask_any_and(cpumask_of(random32() % nr_cpu_ids), cpu_online_mask);
+        if (cpu < nr_cpu_ids)
+            set_cpus_allowed_ptr(current, cpumask_of(cpu));
+        break;
+    case OP_POLICY:
+        sched_setscheduler(current, random32() % 4 ? SCHED_RAS : SCHED_NORMAL, &param);
+        break;
+    case OP_YIELD:
+        yield();
+        break;
+    case OP_YIELD_TO:
+        target = ACCESS_ONCE(stress_all[random32() % nr_threads].tsk);
+        if (!IS_ERR_OR_NULL(target) && target != current)
+            yield_to(target, true);
+        break;
+    }
+
+    st->ops[op]++;
+    st->ns[op] += local_clock() - start;
+}
+
+static int stress_thread(void *data)
+{
+    struct sched_param param = { .sched_priority = 0 };
+    struct stress *st = data;
+
+    ras_trace_start(current);
+    sched_setscheduler(current, SCHED_RAS, &param);
+
+    while (!kthread_should_stop())
+        stress_op(st, random32() % NR_OPS);
+
+    sched_setscheduler(current, SCHED_NORMAL, &param);
+    ras_trace_stop(current);
+
+    return 0;
+}
+
+static int ras_selftest_init(void)
+{
+    struct stress *stress;
+    unsigned long end, checks = 0;
+    u64 check_ns = 0, start, late = 0, sleeps = 0;
+    int i, op, cpu, errors = 0;
+
+    if (nr_threads <= 0)
+        nr_threads = 4 * num_online_cpus();
+
+    stress = kcalloc(nr_threads, sizeof(*stress), GFP_KERNEL);
+    if (!stress)
+        return -ENOMEM;
+    stress_all = stress;
+
+    for (i = 0; i < nr_threads; i++)
+    {
+        stress[i].tsk = kthread_run(stress_thread, &stress[i], "ras_stress/%d", i);
+        if (IS_ERR(stress[i].tsk))
+        {
+            stress[i].tsk = NULL;
+            break;
+        }
+        get_task_struct(stress[i].tsk);
+    }
+
+    /* check every run queue until the time is up */
+    end = jiffies + duration * HZ;
+    while (time_before(jiffies, end))
+    {
+        for_each_online_cpu(cpu)
+        {
+            start = local_clock();
+            errors += ras_check_rq(cpu);
+            check_ns += local_clock() - start;
+            checks++;
+        }
+        msleep(10);
+    }
+
+    /* the running threads may still yield to the stopped ones */
+    for (i = 0; i < nr_threads && stress[i].tsk; i++)
+        kthread_stop(stress[i].tsk);
+    for (i = 0; i < nr_threads && stress[i].tsk; i++)
+        put_task_struct(stress[i].tsk);
+    nr_threads = i;
+
+    for_each_online_cpu(cpu)
+        errors += ras_check_rq(cpu);
+
+    printk(KERN_INFO "ras_selftest:: threads: %d, duration: %ds, checks: %lu, %lluns per check, broken invariants: %d\n",
+           nr_threads, duration, checks, checks ? div64_u64(check_ns, checks) : 0, errors);
+
+    for (op = 0; op < NR_OPS; op++)
+    {
+        unsigned long ops = 0;
+        u64 ns = 0;
+
+        for (i = 0; i < nr_threads; i++)
+        {
+            ops += stress[i].ops[op];
+            ns += stress[i].ns[op];
+        }
+        printk(KERN_INFO "ras_selftest:: %s: %lu ops, %lluns per op\n",
+               op_name[op], ops, ops ? div64_u64(ns, ops) : 0);
+    }
+
+    for (i = 0; i < nr_threads; i++)
+    {
+        late += stress[i].sleep_late_ns;
+        sleeps += stress[i].ops[OP_SLEEP];
+    }
+    printk(KERN_INFO "ras_selftest:: wakeup latency: %lluns per sleep\n",
+           sleeps ? div64_u64(late, sleeps) : 0);
+
+    kfree(stress);
+
+    return errors ? -EINVAL : 0;
+}
+
+static void ras_selftest_exit(void)
+{
+}
+module_init(ras_selftest_init);
+module_exit(ras_selftest_exit);
@@ -23,9 +23,28 @@ Test if we can change a task's scheduler into RAS.
 #define SCHED_IDLE 5
 #define SCHED_RAS 6
 
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define START_TRACE 181
+#define RAS_CTL 184
+#else
+#define START_TRACE 361
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_SET_ATTR 4
+#define RAS_CTL_GET_ATTR 5
+
 char *SCHED_NAME[] = {"SCHED_NORMAL", "SCHED_FIFO", "SCHED_RR",
 					  "SCHED_BATCH", "", "SCHED_IDLE", "SCHED_RAS"};
 
+/* same layout as struct sched_ras_attr in the kernel */
+struct sched_ras_attr
+{
+	int priority;	 /* -5..5, added to the weight */
+	int latency;	 /* 0..3, shorter slices, run first after a wakeup */
+	int write_scale; /* 0..1000, percent of wcounts counted for the weight */
+};
+
 /* retuen scheduler and handle exception */
 int get_policy(pid_t pid)
 {
@@ -90,6 +109,7 @@ int main()
 	pid_t pid;
 	int policy;
 	struct sched_param param;
+	struct sched_ras_attr attr;
 
 	/* input scheduling policy */
 	printf("Please input the choice of scheduling algorithms ");
@@ -105,7 +125,7 @@ int main()
 	/* input pid and start trace */
 	printf("Please input the id(PID) of the testprocess : ");
 	scanf("%d", &pid);
-	syscall(361, pid);
+	syscall(START_TRACE, pid);
 	printf("Start trace for task : %d\n", pid);
 
 	/* set priority for SCHED_FIFO and SCHED_RR */
@@ -126,5 +146,17 @@ int main()
 	printf("pre scheduler : %s\n", SCHED_NAME[get_policy(pid)]);
 	set_policy(pid, policy, param);
 	printf("cur scheduler : %s\n", SCHED_NAME[get_policy(pid)]);
+
+	/* set the per-task attributes of SCHED_RAS */
+	if (policy == 6)
+	{
+		printf("Set RAS attributes (priority(-5..5) latency(0..3) write_scale(0..1000)): ");
+		scanf("%d %d %d", &attr.priority, &attr.latency, &attr.write_scale);
+		if (syscall(RAS_CTL, RAS_CTL_SET_ATTR, pid, &attr))
+			printf("set_ras_attr failed: %s\n", strerror(errno));
+		syscall(RAS_CTL, RAS_CTL_GET_ATTR, pid, &attr);
+		printf("current RAS attributes: priority %d, latency %d, write_scale %d\n",
+			   attr.priority, attr.latency, attr.write_scale);
+	}
 	printf("Switch finish.\n");
 }
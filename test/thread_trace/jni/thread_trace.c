@@ -0,0 +1,138 @@
+/*
+Operating System Project 2: thread_trace.c
+
+Create several threads in one process to test the thread group tracing
+(the RAS_CTL_*_TRACE_GROUP operations of system call ras_ctl, 378) and the RAS weighting of a thread group.
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define SCHED_RAS 6
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define GET_TRACE 183
+#define RAS_CTL 184
+#else
+#define GET_TRACE 363
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_START_TRACE_GROUP 0
+#define RAS_CTL_STOP_TRACE_GROUP 1
+#define RAS_CTL_GET_TRACE_GROUP 2
+#define MAX_THREADS 100
+
+struct thread_arg
+{
+	int writes;
+	pid_t tid;
+	int wcounts;
+};
+
+static int page_size;
+
+/* make the page containing the faulting address writable again */
+void segv_handler(int signal_number, siginfo_t *info, void *context)
+{
+	unsigned long page = (unsigned long)info->si_addr & ~(unsigned long)(page_size - 1);
+	mprotect((void *)page, page_size, PROT_READ | PROT_WRITE);
+}
+
+/* randomly write data to a private region, every write faults once */
+void *thread_write(void *data)
+{
+	struct thread_arg *arg = data;
+	struct sched_param param;
+	int alloc_size, i;
+	char *memory;
+
+	arg->tid = syscall(__NR_gettid);
+
+	/* every thread has its own policy, switch this one to RAS */
+	param.sched_priority = 0;
+	if (sched_setscheduler(arg->tid, SCHED_RAS, &param))
+		printf("tid: %d, set scheduler failed: %s\n", arg->tid, strerror(errno));
+
+	alloc_size = 10 * page_size;
+	memory = mmap(NULL, alloc_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	for (i = 0; i < arg->writes; i++)
+	{
+		/* set protection */
+		mprotect(memory, alloc_size, PROT_READ);
+		/* try to write, will receive a SIGSEGV */
+		memory[rand() % alloc_size] = i;
+	}
+
+	/* the wcounts of this thread alone */
+	syscall(GET_TRACE, arg->tid, &arg->wcounts);
+
+	munmap(memory, alloc_size);
+	return NULL;
+}
+
+int main()
+{
+	pthread_t threads[MAX_THREADS];
+	struct thread_arg args[MAX_THREADS];
+	struct sigaction sa;
+	int n, i, sum = 0, wcount = 0, nr_threads = 0;
+
+	srand(time(0));
+	page_size = getpagesize();
+
+	printf("Please input the number of threads: ");
+	scanf("%d", &n);
+	if (n < 1 || n > MAX_THREADS)
+	{
+		printf("The number of threads should be in 1..%d\n", MAX_THREADS);
+		return 1;
+	}
+
+	/* Init segv_handler to handle SIGSEGV */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = &segv_handler;
+	sa.sa_flags = SA_SIGINFO;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	/* start trace for the whole thread group before creating the threads */
+	if (syscall(RAS_CTL, RAS_CTL_START_TRACE_GROUP, getpid()))
+		printf("start_trace_group failed: %s\n", strerror(errno));
+
+	for (i = 0; i < n; i++)
+	{
+		args[i].writes = rand() % 900 + 100;
+		pthread_create(&threads[i], NULL, thread_write, &args[i]);
+	}
+
+	/* query the group while the threads are running */
+	syscall(RAS_CTL, RAS_CTL_GET_TRACE_GROUP, getpid(), &wcount, &nr_threads);
+	printf("running: group wcounts = %d, threads = %d\n", wcount, nr_threads);
+
+	for (i = 0; i < n; i++)
+	{
+		pthread_join(threads[i], NULL);
+		printf("tid: %d, writes: %d, wcounts: %d\n", args[i].tid, args[i].writes, args[i].wcounts);
+		sum += args[i].wcounts;
+	}
+
+	/* stop trace */
+	syscall(RAS_CTL, RAS_CTL_STOP_TRACE_GROUP, getpid());
+
+	/* the group total must include the threads that already exited */
+	syscall(RAS_CTL, RAS_CTL_GET_TRACE_GROUP, getpid(), &wcount, &nr_threads);
+	printf("Task tgid : %d, group Wcount = %d, sum of threads = %d, %s\n",
+		   getpid(), wcount, sum, wcount >= sum ? "OK" : "FAIL");
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+Operating System Project 2: yield_spin.c
+
+Measure how long threads spin on a user-level spinlock when there are more
+threads than cpus, so lock holders are preempted inside the critical
+section. A waiter that has spun for a while either keeps spinning, calls
+sched_yield(), or donates its time slice to the lock holder with the
+RAS_CTL_YIELD_TO operation of system call ras_ctl (378). In the last mode
+the waiters spin, but the holder flags its critical section in the struct
+ras_cs registered with RAS_CTL_CS_REGISTER, so its slice is extended
+instead of running out inside the section.
+
+Donating the slice to the holder must cut the pointless spinning: the test
+fails unless the waiters spin less per acquire with yield_to than with a
+plain sched_yield().
+
+usage: yield_spin [-t threads] [-i iterations] [-s policy]
+    -t  number of threads (default 4 per cpu)
+    -i  critical sections of every thread (default 20000)
+    -s  scheduling policy (default 6, SCHED_RAS)
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SCHED_RAS 6
+/* the system call numbers, see system_call/ */
+#ifdef __x86_64__
+#define RAS_CTL 184
+#else
+#define RAS_CTL 378
+#endif
+#define RAS_CTL_YIELD_TO 7
+#define RAS_CTL_CS_REGISTER 9
+
+/* spins before a waiter yields */
+#define SPIN_LIMIT 1000
+
+enum
+{
+	MODE_SPIN,
+	MODE_YIELD,
+	MODE_YIELD_TO,
+	MODE_CS,
+	NR_MODES,
+};
+
+static const char *mode_name[NR_MODES] = {"spin", "yield", "yield_to", "cs"};
+
+struct ras_cs
+{
+	volatile unsigned int in_cs;
+	volatile unsigned int yield_pending;
+};
+
+static volatile int owner; /* tid of the lock holder, 0 if free */
+static volatile long counter;
+static int mode, policy = SCHED_RAS, iterations = 20000;
+static long total_spins, total_yields;
+
+static void spin_lock(int tid, long *spins, long *yields)
+{
+	int holder, n = 0;
+
+	while (!__sync_bool_compare_and_swap(&owner, 0, tid))
+	{
+		(*spins)++;
+		if (++n % SPIN_LIMIT)
+			continue;
+
+		holder = owner;
+		if (mode == MODE_YIELD)
+		{
+			sched_yield();
+			(*yields)++;
+		}
+		else if (mode == MODE_YIELD_TO && holder && syscall(RAS_CTL, RAS_CTL_YIELD_TO, holder) > 0)
+		{
+			(*yields)++;
+		}
+	}
+}
+
+static void spin_unlock(void)
+{
+	__sync_lock_release(&owner);
+}
+
+static void *worker(void *arg)
+{
+	struct sched_param param;
+	struct ras_cs cs = {0, 0};
+	long spins = 0, yields = 0;
+	int tid = syscall(__NR_gettid);
+	int i, j;
+
+	param.sched_priority = (policy == 1 || policy == 2) ? 99 : 0;
+	if (sched_setscheduler(0, policy, &param))
+		printf("tid: %d, set scheduler failed: %s\n", tid, strerror(errno));
+	if (mode == MODE_CS && syscall(RAS_CTL, RAS_CTL_CS_REGISTER, &cs))
+		printf("tid: %d, register critical section failed: %s\n", tid, strerror(errno));
+
+	for (i = 0; i < iterations; i++)
+	{
+		spin_lock(tid, &spins, &yields);
+		cs.in_cs = 1;
+		/* a critical section long enough to be preempted in */
+		for (j = 0; j < 200; j++)
+			counter++;
+		spin_unlock();
+		cs.in_cs = 0;
+
+		/* the slice was extended for the critical section, give it back */
+		if (cs.yield_pending)
+		{
+			cs.yield_pending = 0;
+			sched_yield();
+			yields++;
+		}
+	}
+
+	if (mode == MODE_CS)
+		syscall(RAS_CTL, RAS_CTL_CS_REGISTER, NULL);
+
+	__sync_fetch_and_add(&total_spins, spins);
+	__sync_fetch_and_add(&total_yields, yields);
+	return NULL;
+}
+
+static long elapsed_ms(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000 + (end.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = 4 * ncpus, i, opt, failed = 0;
+	pthread_t *tids;
+	struct timespec start;
+	long acquires, spins[NR_MODES], ms[NR_MODES];
+
+	while ((opt = getopt(argc, argv, "t:i:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			policy = atoi(optarg);
+			break;
+		default:
+			printf("usage: %s [-t threads] [-i iterations] [-s policy]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	tids = calloc(threads, sizeof(*tids));
+	acquires = (long)threads * iterations;
+
+	for (mode = 0; mode < NR_MODES; mode++)
+	{
+		counter = 0;
+		total_spins = 0;
+		total_yields = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < threads; i++)
+			pthread_create(&tids[i], NULL, worker, NULL);
+		for (i = 0; i < threads; i++)
+			pthread_join(tids[i], NULL);
+
+		ms[mode] = elapsed_ms(&start);
+		spins[mode] = total_spins / acquires;
+		if (counter != acquires * 200)
+			failed++;
+
+		printf("yield_spin: %s: threads: %d, spins per acquire: %ld, yields: %ld, makespan: %ldms, %s\n",
+			   mode_name[mode], threads, spins[mode], total_yields, ms[mode],
+			   counter == acquires * 200 ? "OK" : "FAIL");
+	}
+
+	/* the directed yield has to shorten the spinning of a plain yield */
+	if (spins[MODE_YIELD_TO] >= spins[MODE_YIELD])
+		failed++;
+	printf("yield_to vs yield: spins per acquire: %ld vs %ld, makespan: %ldms vs %ldms, %s\n",
+		   spins[MODE_YIELD_TO], spins[MODE_YIELD], ms[MODE_YIELD_TO], ms[MODE_YIELD],
+		   spins[MODE_YIELD_TO] < spins[MODE_YIELD] ? "SHORTER" : "NOT SHORTER");
+
+	free(tids);
+	return failed ? 1 : 0;
+}